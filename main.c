@@ -1,8 +1,33 @@
+#if defined(__linux__) && !defined(_POSIX_C_SOURCE)
+    #define _POSIX_C_SOURCE 200809L     // glibc hides POSIX functions (fileno) in strict C11 mode
+#endif
 #include <stdio.h>
+#include <stdarg.h>
 #include <ctype.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
 #include <time.h>
+#include <errno.h>
+
+#if defined(__has_include)
+    #if __has_include(<threads.h>) && !defined(__STDC_NO_THREADS__)
+        #include <threads.h>
+        #define HAS_THREADS 1   // C11 threads are optional part of standard library
+    #endif
+#endif
+#ifdef INSTRUMENT
+    #include <signal.h>     // dump of counters on Ctrl+C or SIGUSR1
+#endif
+#if defined(__unix__) || defined(__APPLE__)
+    #include <unistd.h>     // only for number of CPU cores
+    #include <sys/ioctl.h>  // only for size of terminal
+    #include <sys/mman.h>   // game records are read through memory map
+    #include <sys/stat.h>
+    #include <fcntl.h>
+    #define HAS_MMAP 1
+#endif
 
 #define DEFAULT '~'
 #define PLACED_SHIP 'O'
@@ -26,26 +51,160 @@
 #define HORIZONTAL 1
 #define VERTICAL 0
 
+#define AI_HUNT_TARGET 0    // random shots until something is hit
+#define AI_PROBABILITY 1    // shoots where most of possible ship placements lie
+#define AI_MONTE_CARLO 2    // shoots where most of sampled fleets consistent with all shots lie
+#define AI_LEVELS 3
+#define MAX_SHIP 5       // longest ship (hit mask of a ship has 8 bits)
+#define MAX_FLEET 64     // most ships of one player
+#define FLEET_TRIES 1000    // random fleets tried before custom fleet is refused
+#define NO_SHIP -1
+#define AI_NONE -1      // player is not played by computer
+#define NO_PLAYER -1
+
+#define PHASE_PLACEMENT 0   // some fleet is not placed yet
+#define PHASE_SHOOTING 1    // player on turn is awaited to shoot
+#define PHASE_FINISHED 2
+
 #define MAX_NAME 32
-#define NULL_COORD {27, 27}     // bigger than max board-size => never used
+#define SCREEN_ROWS 64      // size of retained screen (biggest board fits)
+#define SCREEN_COLS 256
+#define SCREEN_COLORS 16
+#define PROMPT_ROWS 4       // lines printed under the frame while asking for coordinates
+#define CACHE_LINE 64
+#define STEAL_CHUNK 64      // games taken from own queue at once
+#define SCHEDULER_SLICE 8   // steps of one game before thread of scheduler moves to another game
+#define SLAB_OBJECTS 1024   // objects allocated at once by slab pool
+#define MAX_THREADS 256
+#define BENCH_TIME 0.02     // seconds spent measuring one operation
+#define BENCH_SHIPS 1024    // random ship positions used by place_ship benchmark
+#define LATENCY_BUCKETS 32  // bucket n counts durations from 2^(n-1) to 2^n microseconds
+#define NO_COORD 0xFFFF     // bigger than max board-size => never used
+#define NULL_COORD {NO_COORD, NO_COORD}
+
+#define MAX_BOARD 26
+#define MAX_SHOTS (MAX_BOARD * MAX_BOARD)   // nobody can shoot more times than there are tiles
+#define BOARD_WORDS ((MAX_SHOTS + 63) / 64)    // 676 tiles of the biggest board fit into 11 words
+#define PLACEMENT_WORDS 3   // ship of 5 tiles spans at most 105 tiles -> 3 words of bit-plane
+#define MAX_PLACEMENTS (2 * MAX_BOARD * MAX_BOARD)     // both orientations from every tile
+#define PLACEMENT_TRIES 8   // random placements tried before all free ones are collected
+#define NO_SHOT -1
+
+#define MAX_LARGE_BOARD 4096    // bigger boards than MAX_BOARD have sparse state
+#define PAGE_SIDE 64        // sparse plane is allocated in squares of 64x64 tiles (one word per row)
+#define MAX_PAGES ((MAX_LARGE_BOARD / PAGE_SIDE) * (MAX_LARGE_BOARD / PAGE_SIDE))
+#define FLEET_TILES (MAX_FLEET * MAX_SHIP)
+#define FLEET_INDEX_BITS 10
+#define FLEET_INDEX (1 << FLEET_INDEX_BITS)     // hash table of ship tiles, 3x bigger than FLEET_TILES
+#define LARGE_CANDIDATES (FLEET_TILES * 8)
+#define VIEWPORT 11     // tiles of large board shown around last shot in each direction
+#define RANDOM_TRIES 64     // random draws on large board before it is scanned
+
+#define MC_BUDGET 0.05      // seconds of sampling per move of Monte Carlo AI
+#define MC_BATCH 16     // samples between two checks of time
+#define SPECULATION_STRETCH 20  // speculative Monte Carlo search samples up to this many budgets
+
+#define ARCHIVE_FILE "SeaBattle.rec"  // interactive games are appended here
+#define ARCHIVE_MAGIC "SBREC1\n"   // first 8 bytes of record file (with terminating zero)
+#define ARCHIVE_BUFFER 65536    // records of one game are written in chunks of this size
+#define RECORD_HEADER 24
+#define MAX_RECORD (RECORD_HEADER + 2 * MAX_FLEET * 3 + 2 * MAX_SHOTS * 2)
+
+#define ANALYSIS_CHUNK 4096     // records taken at once by analysis thread
+#define LEARN_MIN_GAMES 10  // fewer recorded games of board size -> nothing is learned
+#define LEARN_SCALE 16      // learned weight multiplies density by 1 to 2 (in 16ths)
+#define LEARN_FLEETS 8      // computer picks best of this many random fleets
+
+#define MAX_BOT_GAMES 1024  // games one bot process keeps in flight (ids 0 to MAX_BOT_GAMES - 1)
+#define BOT_BUFFER 65536    // bytes of commands read (and answers written) at once
+#define BOT_WORDS 8     // most words of one command
+
+#ifdef INSTRUMENT     // compile with -DINSTRUMENT, otherwise all of this is removed
+    #define COUNT(counter) atomic_fetch_add_explicit(&instrument.counter, 1, memory_order_relaxed)
+    #define TIMER_START(timer) double timer = wall_time()
+    #define TIMER_STOP(histogram, timer) instrument_record(instrument.histogram, wall_time() - (timer))
+    #define INSTRUMENT_START() instrument_start()
+#else
+    #define COUNT(counter) ((void)0)
+    #define TIMER_START(timer) ((void)0)
+    #define TIMER_STOP(histogram, timer) ((void)0)
+    #define INSTRUMENT_START() ((void)0)
+#endif
 
 #ifdef _WIN32
     #define CONSOLE system("cls")   // makes ANSI work
+    #define ALIGNED_ALLOC(size) _aligned_malloc(size, CACHE_LINE)   // MinGW has no aligned_alloc
+    #define ALIGNED_FREE(ptr) _aligned_free(ptr)
 #else
     #define CONSOLE 1			// literary makes nothing
+    #define ALIGNED_ALLOC(size) aligned_alloc(CACHE_LINE, size)
+    #define ALIGNED_FREE(ptr) free(ptr)
+#endif
+#ifdef _MSC_VER
+    #define ALWAYS_INLINE __forceinline
+#else
+    #define ALWAYS_INLINE inline __attribute__((always_inline))    // body is copied to every kernel of board size
 #endif
 
+typedef struct board {
+    uint64_t ships[BOARD_WORDS];    // one bit per tile, tile = y * board_size + x
+    uint64_t hits[BOARD_WORDS];     // hit tiles of ships which are still afloat
+    uint64_t misses[BOARD_WORDS];
+    uint64_t sunk[BOARD_WORDS];
+} BOARD;
+
+typedef struct ship_class {
+    const char* name;
+    unsigned char size;
+} SHIP_CLASS;
+
+static const SHIP_CLASS SHIP_CLASSES[] = {
+    {"Carrier", 5}, {"Battleship", 4}, {"Destroyer", 3}, {"Submarine", 3}, {"Patrol Boat", 2}, {"Dinghy", 1}
+};
+#define CLASS_COUNT (int)(sizeof(SHIP_CLASSES) / sizeof(SHIP_CLASSES[0]))
+
+typedef struct fleet_definition {
+    unsigned char count;
+    unsigned char classes[MAX_FLEET];   // index to SHIP_CLASSES for every ship
+} FLEET;
+
+static const FLEET CLASSIC_FLEET = {5, {0, 1, 2, 3, 4}};
+
+typedef struct fleet_ship {
+    unsigned int origin;        // tile of TOP or LEFT end
+    unsigned char size;
+    unsigned char orientation;
+    unsigned char hits;         // bit i is set when i-th tile from origin was hit
+    unsigned char ship_class;   // index to SHIP_CLASSES
+} FLEET_SHIP;
+
 typedef struct player_fleet {
     char nick[MAX_NAME];
-    char* carrier[5];
-    char* battleship[4];
-    char* destroyer[3];
-    char* submarine[3];
-    char* patrol_boat[2];
-    char** player_board;
-    char* last_shot;
+    BOARD* player_board;
+    int last_shot;      // tile of opponent's board, NO_SHOT before first round
+    unsigned char fleet_size;
+    unsigned char ships_afloat;
+    FLEET_SHIP ships[MAX_FLEET];    // descriptors of all ships, stored one after another
+    unsigned char ship_at[MAX_SHOTS];   // ship id + 1 for each tile (0 = water)
 } PLAYER;
 
+typedef struct shot_result {
+    int flag;       // INVALID, VALID_MISS or VALID_HIT
+    int sunk;       // id of ship sunk by this shot or NO_SHIP
+    int victory;    // 1 if whole enemy fleet is destroyed
+} SHOT;
+
+typedef struct random_generator {
+    uint64_t s[4];      // xoshiro256** state, never all zero
+} RNG;
+
+typedef struct game_session {
+    _Alignas(CACHE_LINE) BOARD boards[2];   // each board starts on its own cache line
+    _Alignas(CACHE_LINE) PLAYER players[2];     // players[i].player_board points to boards[i]
+    RNG rng;    // placement of computer's fleets - seeded per game
+    FLEET fleet;    // ships of both players
+} SESSION;
+
 typedef struct ship {
     unsigned short orientation;
     unsigned short size;
@@ -53,11 +212,368 @@ typedef struct ship {
     unsigned short y;
 } SHIP;
 
+typedef struct ship_placement {
+    uint64_t mask[PLACEMENT_WORDS];     // tiles of ship, mask[0] is word 'word' of bit-plane
+    unsigned short x;
+    unsigned short y;
+    unsigned char word;
+    unsigned char orientation;
+} PLACEMENT;
+
+typedef struct placement_table {    // all legal placements on one board size - never changes once published
+    PLACEMENT placements[MAX_SHIP + 1][MAX_PLACEMENTS];     // placements[n] = placements of ship of size n
+    int count[MAX_SHIP + 1];
+} PLACEMENTS;
+
+typedef struct frame {
+    char* data;     // whole screen, written to console at once
+    size_t length;
+    size_t capacity;
+    const char* color;  // color active at the end of data
+} FRAME;
+
+typedef struct screen_cell {
+    char sign;
+    unsigned char color;    // index to table of colors
+} CELL;
+
+typedef struct retained_screen {
+    CELL cells[SCREEN_ROWS][SCREEN_COLS];   // what is drawn in the terminal
+    int end_row;    // cursor position after the frame
+    int end_col;
+    int too_big;    // frame did not fit - cannot be compared
+} RETAINED;
+
 typedef struct coord {
     unsigned short x;
     unsigned short y;
 } _COORD;
 
+typedef struct ai_state {
+    int level;      // AI_HUNT_TARGET, AI_PROBABILITY or AI_MONTE_CARLO
+    RNG rng;        // own stream - choice of shots does not depend on the other player
+    double budget;  // seconds of sampling per move (AI_MONTE_CARLO)
+    unsigned long sample_limit;     // move ends after this many samples (0 = only budget)
+    int threads;    // sampling threads including the caller
+    const uint32_t* prior;  // ship tiles of recorded human fleets per tile (NULL = nothing learned)
+    const uint32_t* avoid;  // first hits of recorded human players per tile - own fleet avoids them
+    int speculative;    // move is computed in advance while the other player is on turn
+    _Atomic int hurry;  // other player has moved - speculative search ends after its normal budget
+    unsigned short open_hits[MAX_SHOTS];    // HIT tiles of ships which are not sunk yet
+    int open_count;
+    unsigned short candidates[MAX_SHOTS];   // stack of unknown tiles next to open hits, best one on top
+    int candidate_count;
+    unsigned short pool[2][MAX_SHOTS];  // tiles not shot yet, pool[1] holds tiles with odd x + y
+    int pool_count[2];
+    unsigned short pool_slot[MAX_SHOTS];    // position of tile in its pool
+    unsigned char afloat[MAX_SHIP + 1];     // afloat[n] = number of opponent's ships of size n still afloat
+    uint64_t blocked[BOARD_WORDS];  // MISS and SUNK tiles - no afloat ship can lie there
+    unsigned short ship_density[MAX_SHIP + 1][MAX_SHOTS];  // legal placements of one ship of size n over tile
+    unsigned int density[MAX_SHOTS];    // legal placements of all afloat ships over tile
+} AI;
+
+typedef struct engine_kernels {     // hot paths compiled for one board size (see board_kernels)
+    SHOT (*fire)(PLAYER* player_opponent, _COORD aim);
+    void (*observe)(AI* ai, PLAYER* player_opponent, _COORD aim, SHOT shot);
+    void (*fill_density)(AI* ai);
+} KERNELS;
+
+typedef struct game_archive {
+    FILE* file;     // opened for appending, unbuffered - only whole chunks are written
+#ifdef HAS_THREADS
+    mtx_t lock;     // games of all simulation threads share the file
+#endif
+} ARCHIVE;
+
+typedef struct game_state {
+    SESSION session;    // boards, players, generator and fleet
+    AI ai[2];       // ai[i] chooses shots of player i (only if ai_level[i] != AI_NONE)
+    int ai_level[2];
+    unsigned int board_size;
+    int turn;       // player who fires next
+    int winner;     // NO_PLAYER until one fleet is destroyed
+    int phase;      // PHASE_PLACEMENT, PHASE_SHOOTING or PHASE_FINISHED
+    int placed[2];  // placed[i] = fleet of player i is ready
+    void* context;  // owner's data (e.g. statistics of scheduled simulation)
+    const KERNELS* kernels;     // specialized for board size at game start
+#ifdef HAS_THREADS
+    thrd_t speculation;     // computes next move of AI while the other player is on turn
+#endif
+    int speculating;    // speculation was started and not joined yet
+    int speculation_ready;  // speculated move is computed and not taken yet
+    int speculated_player;
+    _COORD speculated;  // result of speculation
+    uint64_t seed;  // random stream of game (kept for record)
+    uint64_t stream;
+    ARCHIVE* archive;   // finished games are recorded here (NULL = not recorded)
+    unsigned char* archive_buffer;  // records waiting for write
+    size_t archive_used;
+    int shot_count;
+    unsigned short shots[2 * MAX_SHOTS];    // tiles of all valid shots, players alternate
+} GAME;
+
+typedef struct game_scheduler {
+#ifdef HAS_THREADS
+    mtx_t lock;
+    cnd_t wake;     // game was queued or scheduler stops
+    cnd_t idle;     // queue is empty and no game is stepped
+    thrd_t threads[MAX_THREADS];
+#endif
+    int thread_count;
+    GAME** queue;   // ring of games which can step (each game at most once)
+    int capacity;
+    int head;
+    int count;
+    int stepping;   // games taken from queue and being stepped
+    int stopping;
+    void (*finished)(struct game_scheduler* scheduler, GAME* game);     // called by any thread, may queue game again
+    void* context;
+} SCHEDULER;
+
+typedef struct interleaved_run {    // simulation on scheduler - context of its SCHEDULER
+    _Atomic unsigned long next;     // next game to be started
+    unsigned long games;
+    unsigned int board_size;
+    int ai_level;
+    uint64_t seed;
+} INTERLEAVED;
+
+typedef struct compact_game {   // pointer-free state of one game - copied with memcpy (see game_compact)
+    uint64_t seed;      // random stream of game
+    uint64_t stream;
+    RNG rng;        // generator of session
+    RNG ai_rng[2];
+    double budget[2];   // search settings of AIs
+    uint32_t samples[2];
+    uint16_t threads[2];
+    uint16_t shot_count;
+    uint16_t candidate_count[2];
+    uint16_t speculated;    // tile of move computed in advance, NO_COORD = none
+    uint8_t board_size;
+    uint8_t fleet_count;
+    uint8_t phase;
+    uint8_t placed;     // bit i = fleet of player i is ready
+    int8_t ai_level[2];
+    uint8_t speculated_player;
+    char nick[2][MAX_NAME];
+    unsigned char data[];   // ships of both players, then board_size^2 tiles per player (see compact_size)
+} COMPACT;
+
+typedef struct slab_pool {
+    size_t object_size;
+    unsigned char** slabs;  // blocks of SLAB_OBJECTS objects, never moved
+    int slab_count;
+    int slab_capacity;
+    void* free_list;    // first free object - free object holds pointer to the next one
+    size_t live;        // objects taken and not given back
+} SLAB;
+
+typedef struct record_file {
+    unsigned char* data;    // whole file, records start after ARCHIVE_MAGIC
+    size_t size;
+    int mapped;     // 1 = memory map, 0 = read to allocated memory
+} RECORDS;
+
+typedef struct board_statistics {
+    uint32_t games;
+    uint32_t players[2];    // players[c] = players of class c in all games (0 = human, 1 = computer)
+    uint32_t first_hits[2][MAX_SHOTS];  // first_hits[c][tile] = first hit of player of class c was there
+    uint32_t fleet[2][MAX_SHOTS];   // fleet[c][tile] = fleet placed by player of class c had ship there
+    uint32_t wins[AI_LEVELS + 1][MAX_SHOTS + 1];    // wins[level + 1][shots fired by winner]
+} BOARD_STATS;
+
+typedef struct analysis {
+    BOARD_STATS boards[MAX_BOARD + 1];  // by board size
+    unsigned long records;
+    unsigned long skipped;  // whole records which cannot come from this program (not counted in boards)
+    size_t damaged;     // bytes at the end of file which are not whole records
+} ANALYSIS;
+
+typedef struct analysis_worker {
+    RECORDS* records;
+    const size_t* chunks;   // offset of every ANALYSIS_CHUNK-th record, last one is end of records
+    size_t chunk_count;
+    _Atomic size_t* next;   // next chunk to be taken by any thread
+    ANALYSIS* result;   // own statistics of thread - merged after join
+} ANALYSIS_WORKER;
+
+static const char* const AI_NAMES[AI_LEVELS + 1] = {"human", "hunt", "probability", "montecarlo"};   // by level + 1
+
+typedef struct game_record {    // view of one record - points into RECORDS data, nothing is copied
+    unsigned int board_size;
+    unsigned int fleet_count;
+    int ai_level[2];    // AI_NONE for human
+    int winner;
+    unsigned int shot_count;
+    unsigned int shot_bytes;    // 1 on boards up to 16x16, else 2
+    uint64_t seed;
+    uint64_t stream;
+    const unsigned char* ships;     // 3 bytes per ship, fleet of player 0 then player 1
+    const unsigned char* shots;
+} RECORD;
+
+typedef struct bot_state {
+    GAME* games[MAX_BOT_GAMES];     // allocated on first use of id, reused by next game with the same id
+    unsigned char active[MAX_BOT_GAMES];
+    int pending[MAX_BOT_GAMES];     // tile of last 'shot' whose result did not come yet (NO_SHOT = none)
+    int ai_level;
+    int threads;    // sampling threads of Monte Carlo AI
+    uint64_t seed;
+    uint64_t started;   // game n gets stream n of the seed
+} BOT;
+
+typedef struct sparse_plane {
+    uint64_t* pages[MAX_PAGES];     // page is allocated on first write, NULL = no tile is set
+    int page_count;
+} SPARSE;
+
+typedef struct large_player {
+    char nick[MAX_NAME];
+    int last_shot;      // tile of opponent's board, NO_SHOT before first round
+    unsigned char fleet_size;
+    unsigned char ships_afloat;
+    unsigned long shots_taken;  // shots of opponent at this fleet
+    unsigned long hits_taken;
+    FLEET_SHIP ships[MAX_FLEET];
+    unsigned int index_tiles[FLEET_INDEX];  // tile + 1 of every ship tile, open addressing (0 = empty slot)
+    unsigned char index_ids[FLEET_INDEX];   // id of ship lying on index_tiles[i]
+    SPARSE shots;   // HIT, MISS and SUNK tiles of this board
+} LARGE_PLAYER;
+
+typedef struct large_ai {
+    RNG rng;
+    int open_hits[FLEET_TILES];     // HIT tiles of ships which are not sunk yet
+    int open_count;
+    int candidates[LARGE_CANDIDATES];
+    int candidate_count;
+    unsigned int odd_left;  // tiles with odd x + y which were not shot yet
+} LARGE_AI;
+
+typedef struct large_session {
+    LARGE_PLAYER players[2];
+    LARGE_AI ai[2];
+    RNG rng;
+    FLEET fleet;
+} LARGE_SESSION;
+
+typedef struct search_job {
+    uint64_t blocked[BOARD_WORDS];  // MISS and SUNK tiles - no afloat ship lies there
+    uint64_t hits[BOARD_WORDS];     // HITs of afloat ships - every sample covers them
+    int afloat[MAX_SHIP + 1];   // afloat[n] = number of afloat ships of size n
+    unsigned int board_size;
+    const PLACEMENTS* placements;   // of this board size
+    double deadline;
+    double soon;    // normal budget of speculative search - it may end here once hurried
+    _Atomic int* hurry;     // NULL if search is not speculative
+    unsigned long limit;    // samples of whole search (0 = until deadline)
+    _Atomic unsigned long total;    // samples of all threads so far
+} SEARCH;
+
+typedef struct search_sampler {
+    _Alignas(CACHE_LINE) unsigned int counts[MAX_SHOTS];   // samples with ship on tile (each thread has own)
+    RNG rng;
+    unsigned long samples;
+} SAMPLER;
+
+#ifdef HAS_THREADS
+typedef struct search_pool {
+    mtx_t lock;
+    cnd_t start;    // new search was posted
+    cnd_t done;     // last helper finished
+    int helpers;    // threads waiting for searches (caller samples too)
+    int active;     // helpers used by current search
+    int running;
+    unsigned long generation;   // number of posted searches
+    SEARCH* job;
+    SAMPLER samplers[MAX_THREADS];  // samplers[0] belongs to caller
+} SEARCH_POOL;
+#endif
+
+typedef struct simulation_stats {
+    unsigned long games;
+    unsigned long long total_shots;
+    unsigned long histogram[MAX_SHOTS + 1];  // histogram[n] = number of games won with n shots
+    double seconds;
+    uint64_t seed;      // same seed and number of games -> same results
+    FLEET fleet;
+} SIM_STATS;
+
+typedef struct tournament_worker {
+    _Alignas(CACHE_LINE) _Atomic uint64_t queue;    // games left: first in low 32 bits, end in high 32 bits
+    _Alignas(CACHE_LINE) SIM_STATS stats;   // written only by owner thread -> merged after join
+    uint64_t seed;      // same for all workers - every game has its own stream
+    const FLEET* fleet;
+    unsigned int board_size;
+    int ai_level;
+    int id;
+    int threads;
+    struct tournament_worker* workers;  // all workers (to steal from)
+} WORKER;
+
+typedef struct hosted_run {     // simulation of compact sessions - shared by its threads
+    _Atomic unsigned long next;     // next game to be started
+    unsigned long games;
+    unsigned int board_size;
+    int ai_level;
+    uint64_t seed;
+    const FLEET* fleet;
+    COMPACT** sessions;     // session i is stepped only by thread i % threads
+    int concurrent;
+    int threads;
+} HOSTED;
+
+typedef struct hosted_thread {
+    _Alignas(CACHE_LINE) SIM_STATS stats;   // written only by own thread -> merged after join
+    HOSTED* run;
+    int id;
+} HOST_THREAD;
+
+#ifdef INSTRUMENT
+typedef struct instrumentation {
+    _Atomic unsigned long invalid_player;   // INVALID coordinates typed by players
+    _Atomic unsigned long invalid_computer; // INVALID shots of AI (should stay 0)
+    _Atomic unsigned long place_rejects;    // ship of user did not fit
+    _Atomic unsigned long placement_misses; // random placement of computer's ship crossed another ship
+    _Atomic unsigned long placement_scans;  // all free placements had to be collected
+    _Atomic unsigned long fleet_restarts;   // computer's fleet did not fit and was placed again
+    _Atomic unsigned long random_shots;
+    _Atomic unsigned long parity_fallbacks; // random shot from even tiles (all odd ones were shot)
+    _Atomic unsigned long candidate_refills;    // candidates were searched again around all open hits
+    _Atomic unsigned long mc_samples;   // fleets sampled by Monte Carlo AI
+    _Atomic unsigned long mc_rejects;   // sampled fleet got stuck and was thrown away
+    _Atomic unsigned long mc_fallbacks; // no sample in budget - density was used instead
+    _Atomic unsigned long mc_sample_misses; // random placement of sampled ship crossed another ship
+    _Atomic unsigned long mc_sample_scans;  // sampler had to collect all free placements
+    _Atomic unsigned long speculated_moves; // AI move was ready before the other player finished
+    _Atomic unsigned long computer_turns[LATENCY_BUCKETS];
+    _Atomic unsigned long player_turns[LATENCY_BUCKETS];   // including typing
+    _Atomic unsigned long renders[LATENCY_BUCKETS];
+} COUNTERS;
+#endif
+
+typedef struct benchmark {
+    GAME* game;
+    SESSION* session;   // session of game
+    AI* ai;     // both AIs of game
+    RNG rng;
+    unsigned int board_size;
+    int ai_level;
+    uint64_t seed;
+    SHIP ships[BENCH_SHIPS];
+    unsigned short order[MAX_SHOTS];    // all tiles shuffled - fire benchmark shoots them one by one
+    BOARD saved_board;      // opponent state restored when whole board was fired at
+    PLAYER saved_player;
+    FRAME frame;        // print_both writes here, frame is never shown
+    uint64_t sink;      // results are summed, so the compiler cannot drop measured calls
+} BENCH;
+
+typedef struct benchmark_case {
+    const char* name;
+    void (*op)(BENCH* bench, unsigned long i);
+    int ai_level;
+    int midgame;    // 1 -> half of the board is shot before measuring
+} BENCH_CASE;
+
 //////////////// CONSOLE GRAPHICS /////////////////
 
 void clear_screen();
@@ -65,57 +581,335 @@ void print_image();
 
 /////////////// PRINTING TO CONSOLE ///////////////
 
-void print_one(PLAYER player, unsigned int board_size);
-void print_both(PLAYER player_active, PLAYER player_opponent, unsigned int board_size);
-void print_tables(PLAYER player_active, PLAYER player_opponent, unsigned int board_size);
-void alive_ship_check(char* pShip[]);
-void default_screen(PLAYER player_active, PLAYER player_opponent, unsigned int board_size);
-void print_hint();
+void print_one(PLAYER* player, unsigned int board_size);
+void print_both(FRAME* frame, PLAYER* player_active, PLAYER* player_opponent, unsigned int board_size);
+void print_tables(FRAME* frame, PLAYER* player_active, PLAYER* player_opponent, unsigned int board_size);
+const char* alive_ship_check(FLEET_SHIP* ship);
+void default_screen(PLAYER* player_active, PLAYER* player_opponent, unsigned int board_size);
+void print_status(FRAME* frame, PLAYER* player_active, PLAYER* player_opponent);
+void print_dialogue(FRAME* frame, const char* nick, char own_shot, char enemy_shot);
+void print_hint(FRAME* frame);
+const char* tile_color(char tile);
+
+/////////////////// FRAME BUFFER //////////////////
+
+void frame_reserve(FRAME* frame, size_t size);
+void frame_text(FRAME* frame, const char* text);
+void frame_char(FRAME* frame, char sign);
+void frame_printf(FRAME* frame, const char* format, ...);
+void frame_color(FRAME* frame, const char* color);
+void frame_flush(FRAME* frame);
+void frame_present(FRAME* frame);
+void frame_rasterize(FRAME* frame, RETAINED* grid);
+void frame_diff(FRAME* frame, RETAINED* old, RETAINED* new);
+int color_id(const char* escape, size_t length);
+int terminal_rows();
 
 //////////////// UI, MENU and GUIDE ///////////////
 
-void main_menu();
+void main_menu(GAME* game);
 void main_menu_intro();
 void main_menu_help();
 
 /////////////////// INITIALIZING //////////////////
 
-char** initialize(char** board, unsigned int board_size);
-void free_board(char** board, unsigned int board_size);
-PLAYER placement_of_ships_user(unsigned int board_size);
-PLAYER placement_of_ships_computer(unsigned int board_size);
-int place_ship(char** board, unsigned int board_size, SHIP active_ship);
-void set_fleet(SHIP active_ship, unsigned short ship_size, int flag, PLAYER *result);
+SESSION* create_session(const FLEET* fleet);
+void reset_session(SESSION* session);
+void free_session(SESSION* session);
+void initialize(BOARD* board);
+void assign_fleet(PLAYER* player, const FLEET* fleet);
+void reset_fleet(PLAYER* player);
+int fleet_fits(const FLEET* fleet, unsigned int board_size);
+void placement_of_ships_user(GAME* game, int player);
+void placement_of_ships_computer(PLAYER* result, RNG* rng, unsigned int board_size);
+int random_fleet(PLAYER* result, RNG* rng, unsigned int board_size);
+int random_placement(const PLACEMENTS* table, BOARD* board, RNG* rng, int ship_size, int sampling);
+static inline int placement_free(BOARD* board, const PLACEMENT* placement);
+const PLACEMENTS* placement_table(unsigned int board_size);
+void build_placements(PLACEMENTS* table, unsigned int board_size);
+int place_ship(BOARD* board, unsigned int board_size, SHIP active_ship);
+void set_ship(PLAYER* result, int id, SHIP active_ship, unsigned int board_size);
+
+/////////////////// GAME ENGINE ///////////////////
+
+GAME* game_create(const FLEET* fleet);
+void game_free(GAME* game);
+int game_start(GAME* game, unsigned int board_size, uint64_t seed, uint64_t stream);
+void game_set_ai(GAME* game, int player, int level);
+void game_set_fleet(GAME* game, const FLEET* fleet);
+void game_set_search(GAME* game, int player, double budget, unsigned long samples, int threads);
+void game_clear_fleet(GAME* game, int player);
+int game_place_ship(GAME* game, int player, int id, SHIP ship);
+void game_place_random(GAME* game, int player);
+void game_finish_placement(GAME* game, int player);
+void game_begin(GAME* game);
+int game_step(GAME* game);
+int game_phase(GAME* game);
+int game_awaits(GAME* game);
+SHOT game_fire(GAME* game, _COORD aim);
+int game_record(GAME* game, _COORD aim, int flag, SHIP* sunk);
+_COORD game_ai_move(GAME* game);
+void game_speculate(GAME* game);
+void speculation_join(GAME* game);
+#ifdef HAS_THREADS
+int speculation_thread(void* arg);
+#endif
+char game_tile(GAME* game, int player, _COORD coord);
+int game_winner(GAME* game);
+void game_set_archive(GAME* game, ARCHIVE* archive);
+void game_flush_archive(GAME* game);
+
+/////////////////// GAME RECORDS //////////////////
+
+ARCHIVE* archive_open(const char* path);
+void archive_close(ARCHIVE* archive);
+void archive_write(ARCHIVE* archive, const unsigned char* data, size_t size);
+void archive_game(GAME* game);
+static inline void put_bytes(unsigned char* data, uint64_t value, int bytes);
+static inline uint64_t get_bytes(const unsigned char* data, int bytes);
+int records_open(RECORDS* records, const char* path);
+void records_close(RECORDS* records);
+size_t records_next(RECORDS* records, size_t offset, RECORD* record);
+static inline int record_shot(const RECORD* record, unsigned int i);
+SHIP record_ship(const RECORD* record, int player, int id);
+int scan_records(const char* path);
+
+//////////////////// ANALYSIS /////////////////////
+
+ANALYSIS* analyze_records(const char* path, int threads);
+int analysis_worker(void* arg);
+int analyze_record(ANALYSIS* analysis, const RECORD* record);
+void print_analysis(ANALYSIS* analysis, double seconds);
+void game_set_learned(GAME* game, int player, const ANALYSIS* analysis);
+void learned_weights(AI* ai, unsigned int weight[], unsigned int board_size);
+uint64_t fleet_heat(PLAYER* player, const uint32_t* heat, unsigned int board_size);
 
 ///////////////////// GAMEPLAY ////////////////////
 
-void player_vs_player(unsigned int board_size);
-void player_vs_computer(unsigned int board_size);
-int player_turn(PLAYER* player_active, PLAYER* player_opponent, unsigned int board_size);
+void player_vs_player(GAME* game, unsigned int board_size);
+void player_vs_computer(GAME* game, unsigned int board_size, int ai_level);
+void console_game(GAME* game);
+int player_turn(GAME* game);
 _COORD get_coord();
-int fire(PLAYER player_opponent, _COORD aim, unsigned int board_size);
-int ship_hit_check(PLAYER player_opponent);
-int victory_check(PLAYER player_opponent);
+int parse_coord(const char* text, _COORD* result);
+void row_name(char* buffer, unsigned int row);
+void coord_name(char* buffer, int tile, unsigned int board_size);
+SHOT fire(PLAYER* player_opponent, _COORD aim, unsigned int board_size);
+static ALWAYS_INLINE SHOT fire_kernel(PLAYER* player_opponent, _COORD aim, unsigned int board_size);
+int victory_check(PLAYER* player_opponent);
+
+///////////////////// BITBOARD ////////////////////
+
+static inline int tile_index(unsigned short x, unsigned short y, unsigned int board_size);
+static inline _COORD tile_coord(int tile, unsigned int board_size);
+static inline int tile_shot(BOARD* board, int tile);
+static inline int bit_get(const uint64_t plane[], int tile);
+static inline void bit_set(uint64_t plane[], int tile);
+static inline void bit_clear(uint64_t plane[], int tile);
+static inline int lowest_bit(uint64_t word);
+static inline int bit_count(uint64_t word);
+static inline int ship_tile(FLEET_SHIP* ship, int i, unsigned int board_size);
+char tile_state(BOARD* board, int tile);
 
 //////////////////////// AI ///////////////////////
 
-int computer_turn(PLAYER* player_active, PLAYER* player_opponent, unsigned int board_size, _COORD *focused_target);
-_COORD calculate_shot(PLAYER* player_active, PLAYER* player_opponent, unsigned int board_size, _COORD *focused_target);
-int line_fire_right(PLAYER* player_opponent, unsigned int board_size, _COORD* calculation);
-int line_fire_left(PLAYER* player_opponent, unsigned int board_size, _COORD* calculation);
-int line_fire_up(PLAYER* player_opponent, unsigned int board_size, _COORD* calculation);
-int line_fire_down(PLAYER* player_opponent, unsigned int board_size, _COORD* calculation);
-int calculation_check(PLAYER* player_opponent, unsigned int board_size, short x, short y);
-_COORD find_last_hit(PLAYER* player_opponent, unsigned int board_size);
-_COORD random_shot(unsigned int board_size);
+_COORD calculate_shot(PLAYER* player_opponent, unsigned int board_size, AI* ai);
+int next_candidate(AI* ai, BOARD* board, unsigned int board_size);
+static ALWAYS_INLINE void push_neighbours(AI* ai, BOARD* board, int tile, unsigned int board_size);
+static ALWAYS_INLINE void push_candidate(AI* ai, BOARD* board, int x, int y, unsigned int board_size);
+void remove_open_hits(AI* ai, BOARD* board);
+_COORD random_shot(AI* ai, unsigned int board_size);
+static ALWAYS_INLINE void pool_remove(AI* ai, int tile, unsigned int board_size);
+int computer_shot(GAME* game);
+
+/////////////////// PROBABILITY AI ////////////////
+
+void ai_reset(AI* ai, int level, const FLEET* fleet, unsigned int board_size);
+static ALWAYS_INLINE void fill_density_kernel(AI* ai, unsigned int board_size);
+void ai_observe(AI* ai, PLAYER* player_opponent, _COORD aim, SHOT shot, unsigned int board_size);
+static ALWAYS_INLINE void observe_kernel(AI* ai, PLAYER* player_opponent, _COORD aim, SHOT shot, unsigned int board_size);
+static ALWAYS_INLINE void ai_block_tile(AI* ai, int tile, unsigned int board_size);
+static ALWAYS_INLINE int ai_window_free(AI* ai, int first, int step, int ship_size);
+static ALWAYS_INLINE void ai_add_window(AI* ai, int first, int step, int ship_size, int amount);
+
+//////////////// SPECIALIZED KERNELS //////////////
+
+const KERNELS* board_kernels(unsigned int board_size);
+_COORD density_shot(AI* ai, unsigned int board_size);
+int best_pool_tile(AI* ai, const unsigned int weight[]);
+
+/////////////////// MONTE CARLO AI ////////////////
+
+_COORD monte_carlo_shot(AI* ai, PLAYER* player_opponent, unsigned int board_size);
+void monte_carlo_run(SEARCH* job, SAMPLER* sampler);
+int monte_carlo_sample(SEARCH* job, SAMPLER* sampler);
+static inline void placement_add(uint64_t plane[], const PLACEMENT* placement);
+#ifdef HAS_THREADS
+SEARCH_POOL* search_pool_get(int helpers);
+int search_helper(void* arg);
+#endif
+
+///////////////////// LARGE BOARD /////////////////
+
+LARGE_SESSION* create_large_session(const FLEET* fleet);
+void reset_large_session(LARGE_SESSION* session);
+void free_large_session(LARGE_SESSION* session);
+static inline int sparse_get(const SPARSE* plane, unsigned int x, unsigned int y);
+void sparse_set(SPARSE* plane, unsigned int x, unsigned int y);
+void sparse_clear(SPARSE* plane);
+void sparse_free(SPARSE* plane);
+static inline unsigned int index_slot(int tile);
+int large_ship_at(LARGE_PLAYER* player, int tile);
+void large_placement(LARGE_PLAYER* result, RNG* rng, unsigned int board_size);
+int large_random_fleet(LARGE_PLAYER* result, RNG* rng, unsigned int board_size);
+SHOT large_fire(LARGE_PLAYER* player_opponent, _COORD aim, unsigned int board_size);
+char large_tile_state(LARGE_PLAYER* player, unsigned int x, unsigned int y, unsigned int board_size);
+void large_ai_reset(LARGE_AI* ai, unsigned int board_size);
+void large_vs_computer(unsigned int board_size);
+int large_player_turn(LARGE_PLAYER* player_active, LARGE_PLAYER* player_opponent, unsigned int board_size);
+void large_screen(LARGE_PLAYER* player_active, LARGE_PLAYER* player_opponent, unsigned int board_size);
+void large_viewport_row(FRAME* frame, LARGE_PLAYER* player, unsigned int x0, unsigned int y, int hide_ships, unsigned int board_size);
+static inline unsigned int viewport_start(int center, unsigned int board_size);
+int large_computer_shot(LARGE_PLAYER* player_active, LARGE_PLAYER* player_opponent, LARGE_AI* ai, unsigned int board_size);
+_COORD large_calculate_shot(LARGE_AI* ai, LARGE_PLAYER* player_opponent, unsigned int board_size);
+void large_push_neighbours(LARGE_AI* ai, LARGE_PLAYER* player_opponent, int tile, unsigned int board_size);
+void large_push_candidate(LARGE_AI* ai, LARGE_PLAYER* player_opponent, int x, int y, unsigned int board_size);
+_COORD large_random_shot(LARGE_AI* ai, LARGE_PLAYER* player_opponent, unsigned int board_size);
+void large_ai_observe(LARGE_AI* ai, LARGE_PLAYER* player_opponent, _COORD aim, SHOT shot, unsigned int board_size);
+int simulate_large_game(LARGE_SESSION* session, unsigned int board_size);
+
+///////////////////// SIMULATION //////////////////
+
+int simulate_game(GAME* game, int ai_level);
+void simulate_games(unsigned long games, unsigned int board_size, int ai_level, uint64_t seed, const FLEET* fleet, SIM_STATS *stats);
+void print_simulation_stats(SIM_STATS *stats, unsigned int board_size);
+int headless_mode(int argc, char* argv[]);
+int parse_fleet(const char* text, FLEET* fleet);
+
+/////////////////// BOT PROTOCOL //////////////////
+
+int bot_mode(int ai_level, uint64_t seed, int threads);
+long bot_read(char* buffer, size_t size);
+int bot_command(BOT* bot, char* line);
+GAME* bot_game(BOT* bot, const char* id_text, int active);
+void bot_new(BOT* bot, GAME* game, int id, char* word[], int count);
+void bot_place(GAME* game, int id);
+void bot_shoot(BOT* bot, GAME* game, int id);
+void bot_result(BOT* bot, GAME* game, int id, char* word[], int count);
+
+///////////////////// TOURNAMENT //////////////////
+
+void run_tournament(unsigned long games, unsigned int board_size, int ai_level, int threads, uint64_t seed, const FLEET* fleet, SIM_STATS *stats);
+int tournament_worker(void* arg);
+int take_games(WORKER* worker, unsigned int* first, unsigned int* count);
+int steal_games(WORKER* thief);
+int cpu_count();
+double wall_time();
+
+///////////////////// SCHEDULER ///////////////////
+
+SCHEDULER* scheduler_create(int threads, int capacity, void (*finished)(SCHEDULER* scheduler, GAME* game), void* context);
+void scheduler_add(SCHEDULER* scheduler, GAME* game);
+void scheduler_wait(SCHEDULER* scheduler);
+void scheduler_free(SCHEDULER* scheduler);
+int scheduler_worker(void* arg);
+int scheduler_run(SCHEDULER* scheduler, GAME* game);
+void run_interleaved(unsigned long games, unsigned int board_size, int ai_level, int threads, int concurrent, uint64_t seed, const FLEET* fleet, SIM_STATS *stats);
+void interleaved_start(INTERLEAVED* run, GAME* game, unsigned long index);
+void interleaved_finished(SCHEDULER* scheduler, GAME* game);
+
+///////////////// COMPACT SESSIONS ////////////////
+
+size_t compact_size(unsigned int board_size, int fleet_count);
+void game_compact(GAME* game, COMPACT* compact);
+int game_restore(GAME* game, const COMPACT* compact);
+SLAB* slab_create(size_t object_size);
+void* slab_alloc(SLAB* pool);
+void slab_release(SLAB* pool, void* object);
+void slab_free(SLAB* pool);
+void run_hosted(unsigned long games, unsigned int board_size, int ai_level, int threads, int concurrent, uint64_t seed, const FLEET* fleet, SIM_STATS *stats);
+void hosted_start(HOSTED* run, GAME* game, unsigned long index);
+int hosted_worker(void* arg);
+
+///////////////////// BENCHMARK /////////////////
+
+void run_benchmarks(unsigned int min_size, unsigned int max_size, uint64_t seed);
+double measure_case(BENCH* bench, const BENCH_CASE* bench_case);
+void prepare_benchmark(BENCH* bench, const BENCH_CASE* bench_case);
+void bench_initialize(BENCH* bench, unsigned long i);
+void bench_reset_session(BENCH* bench, unsigned long i);
+void bench_place_ship(BENCH* bench, unsigned long i);
+void bench_place_fleet(BENCH* bench, unsigned long i);
+void bench_fire(BENCH* bench, unsigned long i);
+void bench_victory_check(BENCH* bench, unsigned long i);
+void bench_calculate_shot(BENCH* bench, unsigned long i);
+void bench_print_both(BENCH* bench, unsigned long i);
+void bench_game(BENCH* bench, unsigned long i);
+
+///////////////////// SELF TEST ///////////////////
+
+int run_selftest();
+void selftest_check(int* checks, int* failed, int ok, const char* what);
+void selftest_random(int* checks, int* failed);
+int selftest_play(GAME* game, unsigned int board_size, uint64_t stream);
+void selftest_records(int* checks, int* failed);
+void selftest_compact(int* checks, int* failed);
+void selftest_bot(int* checks, int* failed);
+#if defined(__unix__) || defined(__APPLE__)
+int selftest_bot_run(const char* commands, char* answers, size_t size);
+#endif
+
+/////////////////// INSTRUMENTATION ///////////////
+
+#ifdef INSTRUMENT
+void instrument_start();
+void instrument_signal(int signal_number);
+void instrument_record(_Atomic unsigned long histogram[], double seconds);
+void instrument_dump();
+void print_histogram(const char* name, _Atomic unsigned long histogram[]);
+#endif
+
+////////////////////// RANDOM /////////////////////
+
+void seed_random(RNG* rng, uint64_t seed, uint64_t stream);
+uint64_t next_random(RNG* rng);
+uint32_t random_below(RNG* rng, uint32_t bound);
+static inline uint64_t rotate_left(uint64_t word, int bits);
+
+
+static FRAME screen = {NULL, 0, 0, NULL};    // buffer is reused by every repaint
+static RETAINED retained[2];    // last drawn screen and the one being drawn
+static int retained_last = 0;   // index of last drawn screen
+static int retained_valid = 0;  // 0 -> something else was printed, next frame is drawn whole
+static char colors[SCREEN_COLORS][16];  // escape sequences of colors used in frames
+static int color_count = 0;
+static _Atomic(const PLACEMENTS*) placement_tables[MAX_BOARD + 1];    // by board size (NULL = not built yet)
+static double search_budget = MC_BUDGET;    // defaults of every new Monte Carlo AI
+static unsigned long search_samples = 0;
+static ARCHIVE* simulation_archive = NULL;  // games of all simulation threads are recorded here
+static ANALYSIS* learned = NULL;    // statistics of recorded interactive games (NULL = none)
+#ifdef HAS_THREADS
+static SEARCH_POOL* search_pool = NULL;     // started by first search with more threads
+#endif
+#ifdef INSTRUMENT
+static COUNTERS instrument;    // shared by all threads
+#endif
 
 
-int main() {
+int main(int argc, char* argv[]) {
+    INSTRUMENT_START();
+    if (argc > 1) return headless_mode(argc, argv);   // command-line flags -> no interactive game
+
     CONSOLE;    // makes ANSI work on Win CMD
     printf(DEFAULT_COLOR);
     char user_input[3];
+    GAME* game = game_create(&CLASSIC_FLEET);    // one allocation for all games
+    learned = analyze_records(ARCHIVE_FILE, cpu_count());   // AI learns from earlier games (NULL = first run)
+    ARCHIVE* archive = archive_open(ARCHIVE_FILE);  // games are not recorded if it cannot be opened
+    game_set_archive(game, archive);
     do {
-        main_menu();    // game starts
+        main_menu(game);    // game starts
+        game_flush_archive(game);   // finished game is saved even if program is killed later
 
         printf("\n\tType 'R' for Restart or anything else to leave: ");
         fgets(user_input, 3, stdin);
@@ -123,6 +917,9 @@ int main() {
         clear_screen();
     } while(user_input[0] == 'r');  // loop until user types R for RESTART
 
+    game_free(game);
+    if (archive) archive_close(archive);
+    free(learned);
     return 0;
 }
 
@@ -133,9 +930,10 @@ int main() {
 
 
 void clear_screen() {
-    /* Clears the screen and sets color to default */
+    /* Clears the screen and sets color to default. Retained frame is not on screen anymore */
 
     printf("\033c"DEFAULT_COLOR);
+    retained_valid = 0;
 }
 
 
@@ -155,194 +953,431 @@ void print_image() {
 ///////////////////////////////////////////////////
 
 
-void print_one(PLAYER player, unsigned int board_size) {
+void print_one(PLAYER* player, unsigned int board_size) {
     /* Prints the game-board of given player while placing fleet */
 
+    FRAME* frame = &screen;
     // first row
-    printf(DEFAULT_COLOR"\n\t   ");
-    for (int i = 0; i < board_size; ++i) {
-        printf("%2d ", i + 1);  // 0 1 2 ...
+    frame_color(frame, DEFAULT_COLOR);
+    frame_text(frame, "\n\t   ");
+    for (unsigned int i = 0; i < board_size; ++i) {
+        frame_printf(frame, "%2d ", i + 1);  // 0 1 2 ...
     }
-    printf("\n");
+    frame_text(frame, "\n");
 
     // rows with tiles
-    for (int i = 0; i < board_size; i++) {
-        printf(DEFAULT_COLOR"\n\t%c  ", 'A' + i);
-        for (int j = 0; j < board_size; j++) {
-            if (player.player_board[j][i] == DEFAULT) printf(BLUE_COLOR);     // sets color
-            else printf(GREEN_COLOR);
-
-            printf(" %c ", player.player_board[j][i]);
+    for (unsigned int i = 0; i < board_size; i++) {
+        frame_color(frame, DEFAULT_COLOR);
+        frame_printf(frame, "\n\t%c  ", 'A' + i);
+        for (unsigned int j = 0; j < board_size; j++) {
+            char tile = tile_state(player->player_board, tile_index(j, i, board_size));
+            if (tile == DEFAULT) frame_color(frame, BLUE_COLOR);     // sets color
+            else frame_color(frame, GREEN_COLOR);
+
+            frame_char(frame, ' ');
+            frame_char(frame, tile);
+            frame_char(frame, ' ');
         }
     }
-    printf("\n\n"DEFAULT_COLOR);
+    frame_text(frame, "\n\n");
+    frame_color(frame, DEFAULT_COLOR);
+    frame_flush(frame);
+    retained_valid = 0;     // placement screen is not retained
 }
 
 
-void print_both(PLAYER player_active, PLAYER player_opponent, unsigned int board_size) {
+void print_both(FRAME* frame, PLAYER* player_active, PLAYER* player_opponent, unsigned int board_size) {
     /* Prints the game-board of given player on left and prints
     other board, where one can see his shots and hits on right */
 
     // header
-    printf(DEFAULT_COLOR"\n\tYour fleet:");
-    for (int i = 0; i < board_size; ++i) printf("   ");
-    printf("\t\tHits and Misses:\n");
+    frame_color(frame, DEFAULT_COLOR);
+    frame_text(frame, "\n\tYour fleet:");
+    for (unsigned int i = 0; i < board_size; ++i) frame_text(frame, "   ");
+    frame_text(frame, "\t\tHits and Misses:\n");
 
     // first row
-    printf("\n\t   ");
-    for (int i = 0; i < board_size; ++i) printf("%2d ", i + 1);  // left board
-    printf("\t\t\t   ");
+    frame_text(frame, "\n\t   ");
+    for (unsigned int i = 0; i < board_size; ++i) frame_printf(frame, "%2d ", i + 1);  // left board
+    frame_text(frame, "\t\t\t   ");
 
-    for (int i = 0; i < board_size; ++i) printf("%2d ", i + 1); // right board
-    printf("\n");
+    for (unsigned int i = 0; i < board_size; ++i) frame_printf(frame, "%2d ", i + 1); // right board
+    frame_text(frame, "\n");
 
     // rows with tiles
-    for (int i = 0; i < board_size; i++) {  // for each line:
-        printf(DEFAULT_COLOR"\n\t%c  ", 'A' + i);
-        for (int j = 0; j < board_size; j++) {    // left board
-            if (player_active.player_board[j][i] == DEFAULT) printf(BLUE_COLOR);     // sets color according to tile
-            else if (player_active.player_board[j][i] == PLACED_SHIP) printf(GREEN_COLOR);
-            else if (player_active.player_board[j][i] == HIT) printf(BRIGHT_RED_COLOR);
-            else if (player_active.player_board[j][i] == MISS) printf(YELLOW_COLOR);
-            else if (player_active.player_board[j][i] == SUNK) printf(RED_COLOR);
-
-            printf(" %c ", player_active.player_board[j][i]);   // prints sign
-        }
-
-        printf("\t\t");
-        printf(DEFAULT_COLOR"\t%c  ", 'A' + i);
-        for (int j = 0; j < board_size; j++) {    // right board
-            if (player_opponent.player_board[j][i] == DEFAULT || player_opponent.player_board[j][i] == PLACED_SHIP) {
-                printf(BLUE_COLOR);
-                printf(" ~ ");          // cannot tell, if enemy ship's there
-                continue;
-            }
-            else if (player_opponent.player_board[j][i] == HIT) printf(BRIGHT_RED_COLOR);
-            else if (player_opponent.player_board[j][i] == MISS) printf(YELLOW_COLOR);
-            else if (player_opponent.player_board[j][i] == SUNK) printf(RED_COLOR);
+    for (unsigned int i = 0; i < board_size; i++) {  // for each line:
+        frame_color(frame, DEFAULT_COLOR);
+        frame_printf(frame, "\n\t%c  ", 'A' + i);
+        for (unsigned int j = 0; j < board_size; j++) {    // left board
+            char tile = tile_state(player_active->player_board, tile_index(j, i, board_size));
+            frame_color(frame, tile_color(tile));   // sets color according to tile (only if it differs)
+            frame_char(frame, ' ');
+            frame_char(frame, tile);   // prints sign
+            frame_char(frame, ' ');
+        }
 
-            printf(" %c ", player_opponent.player_board[j][i]);
+        frame_text(frame, "\t\t");
+        frame_color(frame, DEFAULT_COLOR);
+        frame_printf(frame, "\t%c  ", 'A' + i);
+        for (unsigned int j = 0; j < board_size; j++) {    // right board
+            char tile = tile_state(player_opponent->player_board, tile_index(j, i, board_size));
+            if (tile == PLACED_SHIP) tile = DEFAULT;    // cannot tell, if enemy ship's there
+
+            frame_color(frame, tile_color(tile));
+            frame_char(frame, ' ');
+            frame_char(frame, tile);
+            frame_char(frame, ' ');
         }
     }
-    printf(DEFAULT_COLOR"\n\n");
+    frame_color(frame, DEFAULT_COLOR);
+    frame_text(frame, "\n\n");
 }
 
 
-void print_tables(PLAYER player_active, PLAYER player_opponent, unsigned int board_size) {
-    /* Prints two tables of 5 ships. Active ships are printed green and sunk are red */
+void print_tables(FRAME* frame, PLAYER* player_active, PLAYER* player_opponent, unsigned int board_size) {
+    /* Prints two tables with ships of both fleets. Active ships are printed green and sunk are red */
 
     // header
-    printf(BLUE_COLOR"\t   %s's", player_active.nick);
-    printf(DEFAULT_COLOR" fleet:");
+    frame_color(frame, BLUE_COLOR);
+    frame_printf(frame, "\t   %s's", player_active->nick);
+    frame_color(frame, DEFAULT_COLOR);
+    frame_text(frame, " fleet:");
 
-    for (int i = 0; i < board_size*3 - strlen(player_active.nick) + 19; ++i) printf(" ");   // spaces
+    for (int i = 0; i < (int)(board_size*3 + 19 - strlen(player_active->nick)); ++i) frame_char(frame, ' ');   // spaces
 
-    printf(BRIGHT_RED_COLOR"%s's", player_opponent.nick);
-    printf(DEFAULT_COLOR" fleet:\n");
+    frame_color(frame, BRIGHT_RED_COLOR);
+    frame_printf(frame, "%s's", player_opponent->nick);
+    frame_color(frame, DEFAULT_COLOR);
+    frame_text(frame, " fleet:\n");
 
     // table
-    // Carrier 5
-    alive_ship_check(player_active.carrier);
-    printf("\t   Carrier [5]");     // left table (active)
-    for (int i = 0; i < board_size + 4; ++i) printf("   ");     // spaces
-    alive_ship_check(player_opponent.carrier);
-    printf("     Carrier [5]\n");   // right table (opponent)
-    // Battleship 4
-    alive_ship_check(player_active.battleship);
-    printf("\t   Battleship [4]");
-    for (int i = 0; i < board_size + 4; ++i) printf("   ");
-    alive_ship_check(player_opponent.battleship);
-    printf("  Battleship [4]\n");
-    // Destroyer 3
-    alive_ship_check(player_active.destroyer);
-    printf("\t   Destroyer [3]");
-    for (int i = 0; i < board_size + 4; ++i) printf("   ");
-    alive_ship_check(player_opponent.destroyer);
-    printf("   Destroyer [3]\n");
-    // Submarine 3
-    alive_ship_check(player_active.submarine);
-    printf("\t   Submarine [3]");
-    for (int i = 0; i < board_size + 4; ++i) printf("   ");
-    alive_ship_check(player_opponent.submarine);
-    printf("   Submarine [3]\n");
-    // Patrol Boat 2
-    alive_ship_check(player_active.patrol_boat);
-    printf("\t   Patrol Boat [2]");
-    for (int i = 0; i < board_size + 4; ++i) printf("   ");
-    alive_ship_check(player_opponent.patrol_boat);
-    printf(" Patrol Boat [2]\n");
-}
-
-
-void alive_ship_check(char* pShip[]) {
-    /* Checks, whether tiles of given ship are set to SUNK. If the ship is sunk,
-    color is set to red, otherwise the color is set to green */
-
-    if (*pShip[0] == SUNK) printf(RED_COLOR);
-    else printf(GREEN_COLOR);
-}
-
-
-void default_screen(PLAYER player_active, PLAYER player_opponent, unsigned int board_size) {
+    for (int id = 0; id < player_active->fleet_size; ++id) {
+        FLEET_SHIP* ship = &player_active->ships[id];
+        frame_color(frame, alive_ship_check(ship));
+        frame_printf(frame, "\t   %s [%d]", SHIP_CLASSES[ship->ship_class].name, ship->size);  // left table (active)
+        for (unsigned int i = 0; i < board_size + 4; ++i) frame_text(frame, "   ");     // spaces
+
+        ship = &player_opponent->ships[id];
+        frame_color(frame, alive_ship_check(ship));
+        frame_printf(frame, "%12s [%d]\n", SHIP_CLASSES[ship->ship_class].name, ship->size);    // right table is aligned to right
+    }
+}
+
+
+const char* alive_ship_check(FLEET_SHIP* ship) {
+    /* Checks, whether all tiles of given ship were hit. If the ship is sunk,
+    red color is returned, otherwise green color is returned */
+
+    if (ship->hits == (1 << ship->size) - 1) return RED_COLOR;
+    else return GREEN_COLOR;
+}
+
+
+void default_screen(PLAYER* player_active, PLAYER* player_opponent, unsigned int board_size) {
     /* Prints name of player who is on turn, sums up last round, prints his and opponent's boards and
-    tables with active ships of both players */
+    tables with active ships of both players. Whole screen is composed in frame buffer, but only tiles
+    which changed since last repaint are written to console */
+
+    TIMER_START(start);
+    FRAME* frame = &screen;
+    frame_text(frame, "\033c"DEFAULT_COLOR);  // clears the screen
+    frame->color = DEFAULT_COLOR;
+
+    frame_color(frame, BLUE_COLOR);
+    frame_printf(frame, "\n\t%s's", player_active->nick);
+    frame_color(frame, DEFAULT_COLOR);
+    frame_text(frame, " turn\n");
+
+    print_status(frame, player_active, player_opponent);
+    print_both(frame, player_active, player_opponent, board_size);
+    print_tables(frame, player_active, player_opponent, board_size);
+    print_hint(frame);
+    frame_present(frame);
+    TIMER_STOP(renders, start);
+}
 
-    clear_screen();
-    printf(BLUE_COLOR"\n\t%s's", player_active.nick);
-    printf(DEFAULT_COLOR" turn\n");
 
-    printf("\n\tSTATUS: ");     // dialogue
-    if (player_active.last_shot) {  // based on last hit
-        switch (*player_active.last_shot) {
+void print_status(FRAME* frame, PLAYER* player_active, PLAYER* player_opponent) {
+    /* Prints STATUS line - dialogue based on last shots of both players */
+
+    char own_shot = player_active->last_shot != NO_SHOT ? tile_state(player_opponent->player_board, player_active->last_shot) : 0;
+    char enemy_shot = player_opponent->last_shot != NO_SHOT ? tile_state(player_active->player_board, player_opponent->last_shot) : 0;
+    print_dialogue(frame, player_active->nick, own_shot, enemy_shot);
+}
+
+
+void print_dialogue(FRAME* frame, const char* nick, char own_shot, char enemy_shot) {
+    /* Prints the dialogue of STATUS line. Shots are given as signs of shot tiles (0 = no shot yet),
+    so it is shared by small and large boards */
+
+    frame_text(frame, "\n\tSTATUS: ");     // dialogue
+    if (own_shot) {  // based on last hit
+        switch (own_shot) {
             case MISS:
-                printf(YELLOW_COLOR"'We missed Sir!' ");
+                frame_color(frame, YELLOW_COLOR);
+                frame_text(frame, "'We missed Sir!' ");
                 break;
             case HIT:
-                printf(BRIGHT_GREEN_COLOR"'Great hit %s!' ", player_active.nick);
+                frame_color(frame, BRIGHT_GREEN_COLOR);
+                frame_printf(frame, "'Great hit %s!' ", nick);
                 break;
             case SUNK:
-                printf(GREEN_COLOR"'Good jop %s! Enemy vessel is sinking.' ", player_active.nick);
+                frame_color(frame, GREEN_COLOR);
+                frame_printf(frame, "'Good jop %s! Enemy vessel is sinking.' ", nick);
                 break;
         }
-    } else printf("'Reporting for duty %s! What are your commands?' ", player_active.nick);    // first round
+    } else frame_printf(frame, "'Reporting for duty %s! What are your commands?' ", nick);    // first round
 
-    if (player_opponent.last_shot) {
-        switch (*player_opponent.last_shot) { // based on last hit
+    if (enemy_shot) {
+        switch (enemy_shot) { // based on last hit
             case MISS:
-                printf(YELLOW_COLOR"'Enemy shell missed us.'\n");
+                frame_color(frame, YELLOW_COLOR);
+                frame_text(frame, "'Enemy shell missed us.'\n");
                 break;
             case HIT:
-                printf(BRIGHT_RED_COLOR"'We've been hit!'\n");
+                frame_color(frame, BRIGHT_RED_COLOR);
+                frame_text(frame, "'We've been hit!'\n");
                 break;
             case SUNK:
-                printf(RED_COLOR"'Our boat is sinking! Mayday!'\n");
+                frame_color(frame, RED_COLOR);
+                frame_text(frame, "'Our boat is sinking! Mayday!'\n");
                 break;
         }
-    } else printf("'Let's hunt these dogs.'\n"DEFAULT_COLOR);
-
-    print_both(player_active, player_opponent, board_size);
-    print_tables(player_active, player_opponent, board_size);
-    print_hint();
+    } else {
+        frame_text(frame, "'Let's hunt these dogs.'\n");
+        frame_color(frame, DEFAULT_COLOR);
+    }
 }
 
 
-void print_hint() {
+void print_hint(FRAME* frame) {
     /* Prints one line with description of different chars shown on board */
 
-    printf(BLUE_COLOR"\n\t%c", DEFAULT);
-    printf(DEFAULT_COLOR" - undiscovered water |");
+    frame_color(frame, BLUE_COLOR);
+    frame_printf(frame, "\n\t%c", DEFAULT);
+    frame_color(frame, DEFAULT_COLOR);
+    frame_text(frame, " - undiscovered water |");
+
+    frame_color(frame, GREEN_COLOR);
+    frame_printf(frame, "  %c", PLACED_SHIP);
+    frame_color(frame, DEFAULT_COLOR);
+    frame_text(frame, " - your ship |");
+
+    frame_color(frame, YELLOW_COLOR);
+    frame_printf(frame, "  %c", MISS);
+    frame_color(frame, DEFAULT_COLOR);
+    frame_text(frame, " - miss (empty tile) |");
+
+    frame_color(frame, BRIGHT_RED_COLOR);
+    frame_printf(frame, "  %c", HIT);
+    frame_color(frame, DEFAULT_COLOR);
+    frame_text(frame, " - ship is hit |");
+
+    frame_color(frame, RED_COLOR);
+    frame_printf(frame, "  %c", SUNK);
+    frame_color(frame, DEFAULT_COLOR);
+    frame_text(frame, " - sunk ship");
+}
+
+
+const char* tile_color(char tile) {
+    /* Returns color in which given sign is printed on board */
+
+    switch (tile) {
+        case PLACED_SHIP:
+            return GREEN_COLOR;
+        case HIT:
+            return BRIGHT_RED_COLOR;
+        case MISS:
+            return YELLOW_COLOR;
+        case SUNK:
+            return RED_COLOR;
+        default:
+            return BLUE_COLOR;
+    }
+}
+
+
+///////////////////////////////////////////////////
+/////////////////// FRAME BUFFER //////////////////
+///////////////////////////////////////////////////
+
+
+void frame_reserve(FRAME* frame, size_t size) {
+    /* Makes sure, that another size bytes fit to the buffer. Buffer only grows,
+    so after first repaint no more allocations are needed */
+
+    if (frame->length + size <= frame->capacity) return;
+    while (frame->length + size > frame->capacity) frame->capacity = frame->capacity ? frame->capacity * 2 : 4096;
+    frame->data = (char*) realloc(frame->data, frame->capacity);
+}
+
+
+void frame_text(FRAME* frame, const char* text) {
+    /* Appends text to the frame */
+
+    size_t length = strlen(text);
+    frame_reserve(frame, length);
+    memcpy(frame->data + frame->length, text, length);
+    frame->length += length;
+}
+
+
+void frame_char(FRAME* frame, char sign) {
+    /* Appends one char to the frame */
+
+    frame_reserve(frame, 1);
+    frame->data[frame->length++] = sign;
+}
+
+
+void frame_printf(FRAME* frame, const char* format, ...) {
+    /* Appends formatted text to the frame (same as printf) */
+
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(NULL, 0, format, args);  // finds out the size first
+    va_end(args);
+    if (length < 0) return;
+
+    frame_reserve(frame, length + 1);
+    va_start(args, format);
+    vsnprintf(frame->data + frame->length, length + 1, format, args);
+    va_end(args);
+    frame->length += length;
+}
+
+
+void frame_color(FRAME* frame, const char* color) {
+    /* Switches color. Escape sequence is added only if the color is different from current one */
+
+    if (frame->color && (frame->color == color || !strcmp(frame->color, color))) return;
+    frame_text(frame, color);
+    frame->color = color;
+}
+
+
+void frame_flush(FRAME* frame) {
+    /* Writes whole frame to console with single write and empties the buffer (memory is kept) */
+
+    fwrite(frame->data, 1, frame->length, stdout);
+    fflush(stdout);
+    frame->length = 0;
+}
 
-    printf(GREEN_COLOR"  %c", PLACED_SHIP);
-    printf(DEFAULT_COLOR" - your ship |");
 
-    printf(YELLOW_COLOR"  %c", MISS);
-    printf(DEFAULT_COLOR" - miss (empty tile) |");
+void frame_present(FRAME* frame) {
+    /* Writes full screen frame (starting with screen reset) to console. If the last frame is still on
+    screen, frame is replaced by cursor-positioned updates of changed cells only. Whole frame is
+    written when screen was cleared meanwhile or it could scroll (does not fit to terminal) */
 
-    printf(BRIGHT_RED_COLOR"  %c", HIT);
-    printf(DEFAULT_COLOR" - ship is hit |");
+    RETAINED* old = &retained[retained_last];
+    RETAINED* new = &retained[!retained_last];
+    frame_rasterize(frame, new);
 
-    printf(RED_COLOR"  %c", SUNK);
-    printf(DEFAULT_COLOR" - sunk ship");
+    int rows = terminal_rows();
+    int fits = !new->too_big && (rows == 0 || new->end_row + PROMPT_ROWS < rows);
+    if (retained_valid && fits && !old->too_big) {
+        frame->length = 0;      // frame is already in the grid, buffer is reused for updates
+        frame_diff(frame, old, new);
+    }
+    frame_flush(frame);
+
+    retained_last = !retained_last;
+    retained_valid = fits;
+}
+
+
+void frame_rasterize(FRAME* frame, RETAINED* grid) {
+    /* Replays frame into grid of cells the same way the terminal draws it (new lines,
+    tabs every 8 columns, color escapes and screen reset) */
+
+    int row = 0, col = 0, color = 0;
+    memset(grid, 0, sizeof(RETAINED));
+
+    for (size_t i = 0; i < frame->length; ++i) {
+        char sign = frame->data[i];
+        if (sign == '\033') {
+            if (i + 1 < frame->length && frame->data[i + 1] == 'c') {   // reset - back to top left corner
+                row = col = color = 0;
+                i++;
+                continue;
+            }
+            size_t end = i;
+            while (end < frame->length && frame->data[end] != 'm') end++;   // escape ends with 'm'
+            color = color_id(frame->data + i, end - i + 1);
+            i = end;
+        }
+        else if (sign == '\n') {
+            row++;
+            col = 0;
+        }
+        else if (sign == '\t') col = (col / 8 + 1) * 8;
+        else if (row < SCREEN_ROWS && col < SCREEN_COLS) {
+            grid->cells[row][col].sign = sign;
+            grid->cells[row][col].color = color;
+            col++;
+        }
+        else grid->too_big = 1;
+    }
+    if (row >= SCREEN_ROWS || col >= SCREEN_COLS) grid->too_big = 1;
+    grid->end_row = row;
+    grid->end_col = col;
+}
+
+
+void frame_diff(FRAME* frame, RETAINED* old, RETAINED* new) {
+    /* Appends updates which turn old screen into new one. Each run of changed cells gets one cursor
+    move, colors are switched only when they change. Finally cursor goes to the end of frame and
+    the rest of screen (previous prompt) is erased */
+
+    int cursor_row = -1, cursor_col = -1, color = -1;
+    for (int row = 0; row <= new->end_row; ++row) {
+        for (int col = 0; col < SCREEN_COLS; ++col) {
+            CELL cell = new->cells[row][col];
+            CELL previous = old->cells[row][col];
+            if (cell.sign == previous.sign && cell.color == previous.color) continue;
+            if (row == new->end_row && col >= new->end_col) break;  // erased below anyway
+
+            if (row != cursor_row || col != cursor_col) frame_printf(frame, "\033[%d;%dH", row + 1, col + 1);
+            if (cell.color != color) {
+                frame_text(frame, colors[cell.color]);
+                color = cell.color;
+            }
+            frame_char(frame, cell.sign ? cell.sign : ' ');     // empty cell -> space
+            cursor_row = row;
+            cursor_col = col + 1;
+        }
+    }
+
+    frame_printf(frame, "\033[%d;%dH\033[J", new->end_row + 1, new->end_col + 1);
+    frame_text(frame, frame->color ? frame->color : DEFAULT_COLOR);     // color of frame's end
+}
+
+
+int color_id(const char* escape, size_t length) {
+    /* Returns index of given color escape sequence in color table (new colors are added) */
+
+    for (int i = 0; i < color_count; ++i)
+        if (strlen(colors[i]) == length && !strncmp(colors[i], escape, length)) return i;
+
+    if (color_count == SCREEN_COLORS || length >= sizeof(colors[0])) return 0;
+    memcpy(colors[color_count], escape, length);
+    colors[color_count][length] = '\0';
+    return color_count++;
+}
+
+
+int terminal_rows() {
+    /* Returns number of rows of terminal or 0 if it is unknown (e.g. output is not a terminal) */
+
+    char* lines = getenv("LINES");
+    if (lines) return strtol(lines, NULL, 10);
+#if defined(TIOCGWINSZ)
+    struct winsize size;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == 0) return size.ws_row;
+#endif
+    return 0;
 }
 
 
@@ -351,7 +1386,7 @@ void print_hint() {
 ///////////////////////////////////////////////////
 
 
-void main_menu() {
+void main_menu(GAME* game) {
     /* Main menu where user gives all important information
     and gets needed guidance */
 
@@ -363,26 +1398,40 @@ void main_menu() {
     if (!strcmp(user_input, "h\n") || !strcmp(user_input, "H\n")) main_menu_help();
 
     printf(UNDERLINE_COLOR"\n\tType size");
-    printf(DEFAULT_COLOR" of the board in range 5 to 26 (e.g. '10'): ");
+    printf(DEFAULT_COLOR" of the board in range 5 to %d (e.g. '10'): ", MAX_LARGE_BOARD);
 
     fgets(user_input, 8, stdin);    // inputs board size
-    unsigned int board_size = strtol(user_input, NULL, 10);
-    if (board_size > 26) board_size = 26;   // max size
-    if (board_size < 5) board_size = 5;   // min size
+    long size = strtol(user_input, NULL, 10);   // signed - negative size must not wrap to huge one
+    if (size > MAX_LARGE_BOARD) size = MAX_LARGE_BOARD;   // max size
+    if (size < 5) size = 5;   // min size
+    unsigned int board_size = size;
+    if (board_size > MAX_BOARD) {   // large board has only one mode
+        clear_screen();
+        large_vs_computer(board_size);
+        return;
+    }
 
     printf(UNDERLINE_COLOR"\n\n\tChoose game-mode:");
     printf(DEFAULT_COLOR"\n\tType '1' for: Player vs Player;");
     printf("\n\tType '2' for: Player vs Computer;");
+    printf("\n\tType '3' for: Player vs Computer (hard);");
+    printf("\n\tType '4' for: Player vs Computer (Monte Carlo);");
     printf("\n\tType anything else to leave: ");
 
     fgets(user_input, 8, stdin);    // inputs game-mode
     clear_screen();
     switch (user_input[0]) {
         case '1':
-            player_vs_player(board_size);
+            player_vs_player(game, board_size);
             break;
         case '2':
-            player_vs_computer(board_size);
+            player_vs_computer(game, board_size, AI_HUNT_TARGET);
+            break;
+        case '3':
+            player_vs_computer(game, board_size, AI_PROBABILITY);
+            break;
+        case '4':
+            player_vs_computer(game, board_size, AI_MONTE_CARLO);
             break;
         default:
             break;
@@ -422,7 +1471,9 @@ void main_menu_help() {
     printf("\n\tTwo boards will be displayed. Left shows your ships and enemy strikes. Right tracks your shots.");
     printf("\n\tUnder each board lies table with player's ships (red - sunk, green - active). Each turn you have to");
     printf("\n\ttype coordinates of one enemy tile (e.g.A2). Goal is to guess position of opponents ships and hit it.");
-    printf("\n\tWhen player doesn't have any active ships, his opponent wins and victory screen pops up. GL-HF!\n");
+    printf("\n\tWhen player doesn't have any active ships, his opponent wins and victory screen pops up.");
+    printf("\n\tBoards bigger than %d (up to %d) are played against computer with randomly placed fleets. Rows", MAX_BOARD, MAX_LARGE_BOARD);
+    printf("\n\tare named like columns of spreadsheet (A..Z, AA, AB, ...) and only tiles around last shots are shown. GL-HF!\n");
 }
 
 
@@ -431,667 +1482,4241 @@ void main_menu_help() {
 ///////////////////////////////////////////////////
 
 
-char** initialize(char** board, unsigned int board_size) {
-    /* Allocates memory for game board and sets value of
-    each tile to DEFAULT */
+SESSION* create_session(const FLEET* fleet) {
+    /* Allocates one cache-aligned block for both boards and both players of given fleet. It is
+    allocated only once and reset in place before each game */
+
+    SESSION* session = (SESSION*) ALIGNED_ALLOC(sizeof(SESSION));
+    session->fleet = *fleet;
+    reset_session(session);
+    return session;
+}
+
 
-    board = (char**) malloc(sizeof(char*) * board_size);
-    for (int i = 0; i < board_size; ++i) {
-        board[i] = (char*) malloc(sizeof(char) * board_size);
+void reset_session(SESSION* session) {
+    /* Prepares session for new game - clears both boards, gives both players ships of session's fleet
+    and links each player with his board */
 
-        for (int j = 0; j < board_size; j++) board[i][j] = DEFAULT;
+    for (int i = 0; i < 2; ++i) {
+        initialize(&session->boards[i]);
+        assign_fleet(&session->players[i], &session->fleet);
+        reset_fleet(&session->players[i]);
+        session->players[i].player_board = &session->boards[i];
+        session->players[i].last_shot = NO_SHOT;    // no last shot yet
     }
-    return board;
 }
 
 
-void free_board(char** board, unsigned int board_size) {
-    /* Frees allocated memory for game board */
+void free_session(SESSION* session) {
+    /* Frees memory of session (boards and players) */
 
-    for (int i = 0; i < board_size; ++i) free(board[i]);
-    free(board);
+    ALIGNED_FREE(session);
 }
 
 
-PLAYER placement_of_ships_user(unsigned int board_size) {
-    /* Memory for board will be allocated. Fleet of each player consists of five vessels.
-    Player enters his nick, enters coordinates and places his ships to the board */
+void initialize(BOARD* board) {
+    /* Sets value of each tile to DEFAULT (all bit-planes are empty) */
 
-    clear_screen();
-    PLAYER result;
-    printf("\n\tEnter your nick: ");
-    fgets(result.nick, MAX_NAME, stdin);
-    char* new_line = strchr(result.nick, '\n'); // removes '\n'
-    if(new_line) *new_line = '\0';
+    memset(board, 0, sizeof(BOARD));
+}
+
+
+void assign_fleet(PLAYER* player, const FLEET* fleet) {
+    /* Gives player ships of fleet definition (not placed yet) */
+
+    player->fleet_size = fleet->count;
+    for (int id = 0; id < fleet->count; ++id) {
+        player->ships[id].ship_class = fleet->classes[id];
+        player->ships[id].size = SHIP_CLASSES[fleet->classes[id]].size;
+    }
+}
+
+
+void reset_fleet(PLAYER* player) {
+    /* Removes all ships from tile index of given player. Ships keep their sizes, but are not placed */
+
+    memset(player->ship_at, 0, sizeof(player->ship_at));
+    for (int id = 0; id < player->fleet_size; ++id) {
+        player->ships[id].origin = 0;
+        player->ships[id].hits = 0;
+    }
+    player->ships_afloat = 0;
+}
+
+
+int fleet_fits(const FLEET* fleet, unsigned int board_size) {
+    /* Returns 1 if computer is able to place given fleet to board of given size. Some of FLEET_TRIES
+    random fleets has to fit, otherwise placing would take too long (or forever) */
 
-    char** player_board = NULL;  // allocates memory
-    player_board = initialize(player_board, board_size);
-    result.player_board = player_board;
-    result.last_shot = NULL;    // no last shot yet
+    if (fleet->count == 0) return 0;    // nothing to sink
+    if (board_size > MAX_BOARD) return 1;   // at most FLEET_TILES tiles on 27x27 tiles or more
+    SESSION* session = create_session(fleet);
+    RNG rng;
+    seed_random(&rng, board_size, 0);
 
+    int tries = 0;
+    while (tries < FLEET_TRIES && random_fleet(&session->players[0], &rng, board_size)) tries++;
+    free_session(session);
+    return tries < FLEET_TRIES;
+}
+
+
+void placement_of_ships_user(GAME* game, int player) {
+    /* Fleet of given player is cleared in place. Player enters his nick, enters coordinates
+    and places his ships (of fleet given by game) to the board one by one */
+
+    PLAYER* result = &game->session.players[player];
+    unsigned int board_size = game->board_size;
     char buffer[8];
-    int ship_size = 5;
-    int flag = 1;   // flag 1 = destroyer; flag 0 = submarine (both size 3)
     SHIP active_ship;
+    _COORD start;
 
-    while (ship_size >= 2) {    // this WHILE will run 5 times
-
-        while(1) {  // this WHILE will run until active ship is placed (in case of formatting errors
-            printf("\n\t%s is now placing his ships!\n", result.nick);
-            print_one(result, board_size);
-
-            printf(UNDERLINE_COLOR);
-            switch (ship_size) {
-                case 5:
-                    printf("\n\tPlacing Carrier (5)\n");
-                    break;
-                case 4:
-                    printf("\n\tPlacing Battleship (4)\n");
-                    break;
-                case 3:
-                    if (flag) printf("\n\tPlacing Destroyer (3)\n");
-                    else printf("\n\tPlacing Submarine (3)\n");
-                    break;
-                default:
-                    printf("\n\tPlacing Patrol Boat (2)\n");
-                    break;
-            }
-            printf(DEFAULT_COLOR"\n\tType coordinates of ");
-            printf(UNDERLINE_COLOR"TOP or LEFT");
-            printf(DEFAULT_COLOR" corner of the active ship\n\tfollowed with ");
-            printf(UNDERLINE_COLOR"'H' for horizontal or 'V' for vertical");
-            printf(DEFAULT_COLOR" orientation.\n\tIf the place is occupied, you will be asked again.");
-            printf("\n\tEXAMPLE: placing Destroyer (3) at 'B2 H' places the ship to tiles [B2][B3][B4]");
-            printf("\n\n\tEnter ship placement (e.g. 'A2 H'): ");
-
-            fgets(buffer, 8, stdin);
-            active_ship.x = strtol(buffer + 1, NULL, 10) - 1;   // reading x coordinate
-            buffer[0] = toupper(buffer[0]);
-            active_ship.y = buffer[0] - 'A';    // reading y coordinate
-
-            char *space = strchr(buffer, ' ');
-            if(space) { // if not NULL due to bad formatting
-                space++;
-                *space = toupper(*space);
-                if (*space == 'V') active_ship.orientation = VERTICAL;      // reading orientation
-                else active_ship.orientation = HORIZONTAL;
-
-                active_ship.size = ship_size;
-                clear_screen();
-            }
-            else {  // space == NULL -> formatting Error
-                clear_screen();
-                printf("\n\tFormatting ERROR\n");
-                continue;   // repeat
-            }
-
-            if (place_ship(player_board, board_size, active_ship)) {     // checks if there is an obstacle
-                printf(RED_COLOR"\n\tUnable to place here, restarting...\n"DEFAULT_COLOR);
-            }
-            else {      // ship has been placed
-                result.player_board = player_board; // saves created placement
-                set_fleet(active_ship, ship_size, flag, &result);
-                break;  // ship is placed into board and into player struct - breaks inner WHILE
+    while (1) {     // runs again when user wants to RESTART placement
+        clear_screen();
+        printf("\n\tEnter your nick: ");
+        fgets(result->nick, MAX_NAME, stdin);
+        char* new_line = strchr(result->nick, '\n'); // removes '\n'
+        if(new_line) *new_line = '\0';
+
+        game_clear_fleet(game, player);     // empty board (reused on restart)
+
+        for (int id = 0; id < result->fleet_size; ++id) {     // ships are placed in order of fleet
+            FLEET_SHIP* ship = &result->ships[id];
+
+            while(1) {  // this WHILE will run until active ship is placed (in case of formatting errors
+                printf("\n\t%s is now placing his ships!\n", result->nick);
+                print_one(result, board_size);
+
+                printf(UNDERLINE_COLOR"\n\tPlacing %s (%d)\n", SHIP_CLASSES[ship->ship_class].name, ship->size);
+                printf(DEFAULT_COLOR"\n\tType coordinates of ");
+                printf(UNDERLINE_COLOR"TOP or LEFT");
+                printf(DEFAULT_COLOR" corner of the active ship\n\tfollowed with ");
+                printf(UNDERLINE_COLOR"'H' for horizontal or 'V' for vertical");
+                printf(DEFAULT_COLOR" orientation.\n\tIf the place is occupied, you will be asked again.");
+                printf("\n\tEXAMPLE: placing Destroyer (3) at 'B2 H' places the ship to tiles [B2][B3][B4]");
+                printf("\n\n\tEnter ship placement (e.g. 'A2 H'): ");
+
+                fgets(buffer, 8, stdin);
+                parse_coord(buffer, &start);    // NULL_COORD does not fit to board
+                active_ship.x = start.x;
+                active_ship.y = start.y;
+
+                char *space = strchr(buffer, ' ');
+                if(space) { // if not NULL due to bad formatting
+                    space++;
+                    *space = toupper(*space);
+                    if (*space == 'V') active_ship.orientation = VERTICAL;      // reading orientation
+                    else active_ship.orientation = HORIZONTAL;
+
+                    clear_screen();
+                }
+                else {  // space == NULL -> formatting Error
+                    clear_screen();
+                    printf("\n\tFormatting ERROR\n");
+                    continue;   // repeat
+                }
+
+                if (game_place_ship(game, player, id, active_ship)) {     // checks if there is an obstacle
+                    COUNT(place_rejects);
+                    printf(RED_COLOR"\n\tUnable to place here, restarting...\n"DEFAULT_COLOR);
+                }
+                else break;     // ship is placed into board and into player struct - breaks inner WHILE
             }
         }
 
-        if (ship_size == 3 && flag) { // taking care of two ships with size 3
-            ship_size++;
-            flag = 0;
-        }
-        ship_size--;    // placing ships from largest to smallest
+        printf("\n\t%s is now placing his ships!\n", result->nick);  // shows the result
+        print_one(result, board_size);
+        printf("\n\tType 'R' for RESTART if you are unsatisfied and want to start over.");
+        printf("\n\tType anything else to confirm and continue: ");
+        fgets(buffer, 8, stdin);
+        buffer[0] = tolower(buffer[0]);
+
+        if (buffer[0] != 'r') return;    // user is satisfied - result is saved in struct
     }
+}
+
+
+void placement_of_ships_computer(PLAYER* result, RNG* rng, unsigned int board_size) {
+    /* Places computer's fleet randomly (from given generator). When earlier ships left no space for
+    a later one (only on the smallest boards or with big fleets), whole fleet is placed again */
+
+    strcpy(result->nick, "COMPUTER");
+    while (random_fleet(result, rng, board_size)) COUNT(fleet_restarts);
+}
+
+
+int random_fleet(PLAYER* result, RNG* rng, unsigned int board_size) {
+    /* Clears player's board in place and places ships one by one. Each ship gets random one of its
+    legal placements which do not cross already placed ships, so there are no retries. Returns 0 when
+    whole fleet is placed, 1 if some ship did not fit */
+
+    const PLACEMENTS* table = placement_table(board_size);
+    initialize(result->player_board);
+    reset_fleet(result);
+    result->last_shot = NO_SHOT;
 
-    printf("\n\t%s is now placing his ships!\n", result.nick);  // shows the result
-    print_one(result, board_size);
-    printf("\n\tType 'R' for RESTART if you are unsatisfied and want to start over.");
-    printf("\n\tType anything else to confirm and continue: ");
-    fgets(buffer, 8, stdin);
-    buffer[0] = tolower(buffer[0]);
+    for (int id = 0; id < result->fleet_size; ++id) {
+        int size = result->ships[id].size;
+        int index = random_placement(table, result->player_board, rng, size, 0);
+        if (index < 0) return 1;
 
-    if (buffer[0] == 'r') {
-        free_board(result.player_board, board_size);
-        return placement_of_ships_user(board_size); // recursion - repeating the process
+        const PLACEMENT* placement = &table->placements[size][index];
+        SHIP active_ship = {placement->orientation, size, placement->x, placement->y};
+        for (int i = 0; i < PLACEMENT_WORDS; ++i) result->player_board->ships[placement->word + i] |= placement->mask[i];
+        set_ship(result, id, active_ship, board_size);
     }
-    else return result;     // user is satisfied - returns the result struct
+    return 0;
 }
 
 
-PLAYER placement_of_ships_computer(unsigned int board_size) {
-    /* Allocates memory for computer's board and tries to place ships. Generates random coordinates and
-    if space is occupied, generates other etc. When 5 ships are placed, returns resulting struct */
+int random_placement(const PLACEMENTS* table, BOARD* board, RNG* rng, int ship_size, int sampling) {
+    /* Returns index (in table) of random placement of ship of given size which does not cross any ship on board
+    (three ANDs each). Few random placements are tried first - on common boards one of them fits almost
+    always. Otherwise all free placements are collected, so the cost is bounded. Both ways give each
+    free placement the same chance. sampling = called by Monte Carlo AI (only counters differ).
+    Returns -1 if there is no such placement */
 
-    PLAYER result;
-    strcpy(result.nick, "COMPUTER");
+    unsigned short free[MAX_PLACEMENTS];
+    int count = 0;
 
-    char** player_board = NULL;  // allocates memory
-    player_board = initialize(player_board, board_size);
-    result.player_board = player_board;
-    result.last_shot = NULL;
+    for (int i = 0; i < PLACEMENT_TRIES; ++i) {
+        int index = random_below(rng, table->count[ship_size]);
+        if (placement_free(board, &table->placements[ship_size][index])) return index;
+        if (sampling) COUNT(mc_sample_misses);
+        else COUNT(placement_misses);
+    }
+    if (sampling) COUNT(mc_sample_scans);
+    else COUNT(placement_scans);
 
-    int ship_size = 5;
-    int flag = 1;   // flag 1 = destroyer; flag 0 = submarine (both size 3)
-    SHIP active_ship;
+    for (int i = 0; i < table->count[ship_size]; ++i) {
+        if (placement_free(board, &table->placements[ship_size][i])) free[count++] = i;
+    }
 
-    while (ship_size >= 2) {    // this while will run 5 times
+    if (count == 0) return -1;
+    return free[random_below(rng, count)];
+}
 
-        while(1) {  // this WHILE will run until active ship is placed
 
-            active_ship.size = ship_size;
-            active_ship.orientation = rand()%2; // 0 for VERTICAL, 1 for HORIZONTAL
-            active_ship.x = rand()%board_size;
-            active_ship.y = rand()%board_size;    // generates random ship position
+static inline int placement_free(BOARD* board, const PLACEMENT* placement) {
+    /* Returns 1 if placement does not cross any ship on board */
 
-            if (place_ship(player_board, board_size, active_ship)) continue;  // checks if there is an obstacle
-            // ship has been placed
-            result.player_board = player_board; // saves created placement
-            set_fleet(active_ship, ship_size, flag, &result);
-            break;  // ship is placed into board and into player struct - breaks WHILE
-        }
+    const uint64_t* ships = &board->ships[placement->word];
+    return !((ships[0] & placement->mask[0]) | (ships[1] & placement->mask[1]) | (ships[2] & placement->mask[2]));
+}
+
+
+const PLACEMENTS* placement_table(unsigned int board_size) {
+    /* Returns placements of board of given size (5 to MAX_BOARD). Table of each size is built when it is needed
+    for the first time and never changes after it is published, so games of different sizes on any threads
+    share tables without locks. Thread which loses race for publishing frees its own copy */
+
+    const PLACEMENTS* table = atomic_load_explicit(&placement_tables[board_size], memory_order_acquire);
+    if (table) return table;
+
+    PLACEMENTS* built = (PLACEMENTS*) malloc(sizeof(PLACEMENTS));
+    build_placements(built, board_size);
+    if (atomic_compare_exchange_strong_explicit(&placement_tables[board_size], &table, built, memory_order_acq_rel, memory_order_acquire)) return built;
+    free(built);
+    return table;   // published by other thread meanwhile
+}
 
-        if (ship_size == 3 && flag) { // taking care of two ships with size 3
-            ship_size++;
-            flag = 0;
+
+void build_placements(PLACEMENTS* table, unsigned int board_size) {
+    /* Fills table of all placements of every ship size which fit to board of given size */
+
+    for (int size = 1; size <= MAX_SHIP; ++size) {
+        table->count[size] = 0;
+        for (int y = 0; y < (int)board_size; ++y) {
+            for (int x = 0; x < (int)board_size; ++x) {
+                for (int orientation = VERTICAL; orientation <= HORIZONTAL; ++orientation) {
+                    if (orientation == HORIZONTAL && x + size > (int)board_size) continue;   // doesn't fit to board
+                    if (orientation == VERTICAL && y + size > (int)board_size) continue;
+
+                    PLACEMENT* placement = &table->placements[size][table->count[size]++];
+                    int first = tile_index(x, y, board_size);
+                    int step = orientation == HORIZONTAL ? 1 : board_size;
+                    int word = first >> 6;
+                    if (word > BOARD_WORDS - PLACEMENT_WORDS) word = BOARD_WORDS - PLACEMENT_WORDS;    // stays inside board
+
+                    memset(placement->mask, 0, sizeof(placement->mask));
+                    for (int i = 0; i < size; ++i) bit_set(placement->mask, first + i*step - word*64);
+                    placement->x = x;
+                    placement->y = y;
+                    placement->word = word;
+                    placement->orientation = orientation;
+                }
+            }
         }
-        ship_size--;
     }
-    return result;
 }
 
 
-int place_ship(char** player_board, unsigned int board_size, SHIP active_ship) {
+int place_ship(BOARD* player_board, unsigned int board_size, SHIP active_ship) {
     /* Checks, whether ship can be placed to active_ship coordinates. If yes, function
     places ship to the board and returns 0. If it is impossible to place ship there,
     function returns 1 and doesn't edit the board */
 
-    if (active_ship.x < 0 || active_ship.x >= board_size) return 1;
-    if (active_ship.y < 0 || active_ship.y >= board_size) return 1;
+    if (active_ship.x >= board_size) return 1;
+    if (active_ship.y >= board_size) return 1;
 
+    int step;   // distance between two neighbouring tiles of the ship
     if (active_ship.orientation == HORIZONTAL) {  // horizontal orientation
         if (active_ship.x + active_ship.size > board_size) return 1;    // doesn't fit to board
-
-        for (int i = 0; i < active_ship.size; ++i) {
-            if (player_board[active_ship.x + i][active_ship.y] != DEFAULT) return 1;   // tile is occupied
-        }
-
-        for (int i = 0; i < active_ship.size; ++i) {
-            player_board[active_ship.x + i][active_ship.y] = PLACED_SHIP;   // all good - placing ship
-        }
+        step = 1;
     }
-
-    else if (active_ship.orientation == VERTICAL) {  // vertical orientation
+    else {  // vertical orientation
         if (active_ship.y + active_ship.size > board_size) return 1;    // doesn't fit to board
+        step = board_size;
+    }
 
-        for (int i = 0; i < active_ship.size; ++i) {
-            if (player_board[active_ship.x][active_ship.y + i] != DEFAULT) return 1;   // tile is occupied
-        }
+    int first = tile_index(active_ship.x, active_ship.y, board_size);
+    for (int i = 0; i < active_ship.size; ++i) {
+        if (bit_get(player_board->ships, first + i*step)) return 1;   // tile is occupied
+    }
 
-        for (int i = 0; i < active_ship.size; ++i) {
-            player_board[active_ship.x][active_ship.y + i] = PLACED_SHIP;   // all good - placing ship
-        }
+    for (int i = 0; i < active_ship.size; ++i) {
+        bit_set(player_board->ships, first + i*step);   // all good - placing ship
     }
     return 0;
 }
 
 
-void set_fleet(SHIP active_ship, unsigned short ship_size, int flag, PLAYER *result) {
-    /* Based on active_ship data (size and orientation), only one of following branches is chosen.
-    Within correct branch, pointers to tiles of specific ships are saved to PLAYER struct. E.g. when Carrier
-    is placed on board, two pointers point to each of its 5 tiles (**player_board and **carrier) */
+void set_ship(PLAYER* result, int id, SHIP active_ship, unsigned int board_size) {
+    /* Saves position of placed ship to its descriptor (e.g. Carrier's origin and orientation).
+    Each tile is also marked with id of the ship, so fire can find hit ship without searching */
 
-    if (active_ship.orientation == HORIZONTAL) {    // determine the orientation - horizontal
-        switch (ship_size) {    // find out which type of ship is active
-            case 5:
-                for (int i = 0; i < ship_size; ++i)     // assign each active ship pointers to struct
-                    result->carrier[i] = &result->player_board[active_ship.x + i][active_ship.y];
-                break;
-            case 4:
-                for (int i = 0; i < ship_size; ++i)
-                    result->battleship[i] = &result->player_board[active_ship.x + i][active_ship.y];
-                break;
-            case 3:
-                if (flag)
-                    for (int i = 0; i < ship_size; ++i)
-                        result->destroyer[i] = &result->player_board[active_ship.x + i][active_ship.y];
-                else
-                    for (int i = 0; i < ship_size; ++i)
-                        result->submarine[i] = &result->player_board[active_ship.x + i][active_ship.y];
-                break;
-            default:
-                for (int i = 0; i < ship_size; ++i)
-                    result->patrol_boat[i] = &result->player_board[active_ship.x + i][active_ship.y];
-                break;
-        }
-    } else if (active_ship.orientation == VERTICAL) {   // vertical orientation
-        switch (ship_size) {
-            case 5:
-                for (int i = 0; i < ship_size; ++i)
-                    result->carrier[i] = &result->player_board[active_ship.x][active_ship.y + i];
-                break;
-            case 4:
-                for (int i = 0; i < ship_size; ++i)
-                    result->battleship[i] = &result->player_board[active_ship.x][active_ship.y + i];
-                break;
-            case 3:
-                if (flag)
-                    for (int i = 0; i < ship_size; ++i)
-                        result->destroyer[i] = &result->player_board[active_ship.x][active_ship.y + i];
-                else
-                    for (int i = 0; i < ship_size; ++i)
-                        result->submarine[i] = &result->player_board[active_ship.x][active_ship.y + i];
-                break;
-            default:
-                for (int i = 0; i < ship_size; ++i)
-                    result->patrol_boat[i] = &result->player_board[active_ship.x][active_ship.y + i];
-                break;
-        }
-    }
+    FLEET_SHIP* ship = &result->ships[id];
+    ship->origin = tile_index(active_ship.x, active_ship.y, board_size);
+    ship->orientation = active_ship.orientation;
+    ship->hits = 0;
+    for (int i = 0; i < ship->size; ++i) result->ship_at[ship_tile(ship, i, board_size)] = id + 1;
+    result->ships_afloat++;
 }
 
 
 ///////////////////////////////////////////////////
-///////////////////// GAMEPLAY ////////////////////
+/////////////////// GAME ENGINE ///////////////////
 ///////////////////////////////////////////////////
 
 
-void player_vs_player(unsigned int board_size) {
-    /* PvP mode. Two PLAYER structs are created. Players alternate turns until one destroys all enemy
-    ships what breaks while loop. All allocated memory will be freed when finished */
+GAME* game_create(const FLEET* fleet) {
+    /* Allocates state of one game with given fleet. Engine functions never print or read anything,
+    they only work with game given by pointer - console, simulation and benchmarks are its clients */
+
+    GAME* game = (GAME*) ALIGNED_ALLOC(sizeof(GAME));
+    game->session.fleet = *fleet;
+    reset_session(&game->session);
+    game->ai_level[0] = game->ai_level[1] = AI_NONE;
+    game->board_size = 0;
+    game->turn = 0;
+    game->winner = NO_PLAYER;
+    game->phase = PHASE_PLACEMENT;
+    game->placed[0] = game->placed[1] = 0;
+    game->context = NULL;
+    game->archive = NULL;
+    game->archive_buffer = NULL;
+    game->archive_used = 0;
+    game->shot_count = 0;
+    game->speculating = 0;
+    game->speculation_ready = 0;
+    return game;
+}
 
-    PLAYER player1, player2;
 
-    player1 = placement_of_ships_user(board_size);
-    player2 = placement_of_ships_user(board_size);
+void game_free(GAME* game) {
+    /* Frees memory of game. Records which were not written yet are written first */
 
-    while (1){
-        // first player
-        if (player_turn(&player1, &player2, board_size)) break;
+    speculation_join(game);
+    game_flush_archive(game);
+    free(game->archive_buffer);
+    ALIGNED_FREE(game);
+}
 
-        // second player
-        if (player_turn(&player2, &player1, board_size)) break;
+
+int game_start(GAME* game, unsigned int board_size, uint64_t seed, uint64_t stream) {
+    /* Resets game in place for new board - it awaits placement of both fleets. Nothing is placed and nobody
+    is played by computer yet.
+    All random numbers of the game come from given stream of the seed. Returns 1 if board size is
+    not supported (5 to MAX_BOARD), else 0 */
+
+    if (board_size < 5 || board_size > MAX_BOARD) return 1;
+    speculation_join(game);     // last move of previous game may still be computed
+    game->speculation_ready = 0;
+    seed_random(&game->session.rng, seed, stream);
+    reset_session(&game->session);
+    game->ai_level[0] = game->ai_level[1] = AI_NONE;
+    for (int player = 0; player < 2; ++player) {    // learned statistics are given for each game again
+        game->ai[player].prior = NULL;
+        game->ai[player].avoid = NULL;
     }
+    game->board_size = board_size;
+    game->kernels = board_kernels(board_size);  // the only dispatch on board size
+    game->turn = 0;
+    game->winner = NO_PLAYER;
+    game->phase = PHASE_PLACEMENT;
+    game->placed[0] = game->placed[1] = 0;
+    game->seed = seed;
+    game->stream = stream;
+    game->shot_count = 0;
+    return 0;
+}
 
-    printf(DEFAULT_COLOR"\n\tCongratulations! You just won ");
-    printf(UNDERLINE_COLOR"3 points.\n"DEFAULT_COLOR);
-    free_board(player1.player_board, board_size);
-    free_board(player2.player_board, board_size);
+
+void game_set_ai(GAME* game, int player, int level) {
+    /* Given player will be played by AI of given level - AI learns results of all his shots */
+
+    ai_reset(&game->ai[player], level, &game->session.fleet, game->board_size);
+    game->ai_level[player] = level;
 }
 
 
-void player_vs_computer(unsigned int board_size) {
-    /* PvCPU mode. Two PLAYER structs are created. Player alternates turns with AI until one destroys all enemy
-    ships what breaks while loop. Random seed is generated here. All allocated memory will be freed when finished */
+void game_set_fleet(GAME* game, const FLEET* fleet) {
+    /* Both players get given fleet from next game_start */
 
-    PLAYER player1, player2;
-    _COORD focused_target = {0, 0};
+    game->session.fleet = *fleet;
+}
 
-    player1 = placement_of_ships_user(board_size);
-    srand(time(NULL));
-    player2 = placement_of_ships_computer(board_size);
 
-    while (1){
-        // first player
-        if (player_turn(&player1, &player2, board_size)) break;
+void game_set_search(GAME* game, int player, double budget, unsigned long samples, int threads) {
+    /* Sets time budget per move (seconds), limit of samples per move (0 = none) and number of
+    threads of player's Monte Carlo AI */
 
-        // second player
-        if (computer_turn(&player2, &player1, board_size, &focused_target)) break;
-    }
+    game->ai[player].budget = budget;
+    game->ai[player].sample_limit = samples;
+    game->ai[player].threads = threads;
+}
 
-    printf(DEFAULT_COLOR"\n\tCongratulations! You just won ");
-    printf(UNDERLINE_COLOR"3 points.\n"DEFAULT_COLOR);
-    free_board(player1.player_board, board_size);
-    free_board(player2.player_board, board_size);
+
+void game_clear_fleet(GAME* game, int player) {
+    /* Removes all ships of player from his board (e.g. when he wants to place them again) */
+
+    PLAYER* result = &game->session.players[player];
+    initialize(result->player_board);
+    reset_fleet(result);
+    result->last_shot = NO_SHOT;    // no last shot yet
+    game->placed[player] = 0;
 }
 
 
-int player_turn(PLAYER* player_active, PLAYER* player_opponent, unsigned int board_size) {
-    /* Pointers to active player's and opponent's struct are passed and edited. Function prints boards
-    from active_player's perspective and asks him for coordinates to shoot at. This is repeated until
-    valid coordinates are passed. If player hits opponent, ship_hit_check is called (checks, if that hit
-    was deadly). If yes, victory condition is checked. If satisfied, returns 1. Else returns 0 */
+int game_place_ship(GAME* game, int player, int id, SHIP ship) {
+    /* Places ship with given id of player's fleet (its size is taken from fleet). Returns 0 if it
+    was placed, 1 if it does not fit to board or crosses other ship */
 
-    _COORD aim;
-    int flag;
+    PLAYER* result = &game->session.players[player];
+    ship.size = result->ships[id].size;
+    if (place_ship(result->player_board, game->board_size, ship)) return 1;
+    set_ship(result, id, ship, game->board_size);
+    return 0;
+}
 
-    default_screen(*player_active, *player_opponent, board_size);
-    aim = get_coord();
-    flag = fire(*player_opponent, aim, board_size);
-    while(flag == INVALID) {    // repeats until valid coordinates are given
-        printf(UNDERLINE_COLOR"\n\tInvalid shot Captain!");
-        aim = get_coord();
-        flag = fire(*player_opponent, aim, board_size);
-    }
-    player_active->last_shot = &(player_opponent->player_board[aim.x][aim.y]);
-
-    if (flag == VALID_HIT) {    // target was hit
-        if (ship_hit_check(*player_opponent))   // ship was sunk
-            if (victory_check(*player_opponent)) {  // victory screen
-                default_screen(*player_active, *player_opponent, board_size);
-                printf(BRIGHT_RED_COLOR"\n\t##################################\n");
-                printf("\t##################################\n");
-                printf("\t  ------- VICTORY %s -------\n", player_active->nick);
-                printf("\t##################################\n");
-                printf("\t##################################\n");
-                return 1;
-            }
+
+void game_place_random(GAME* game, int player) {
+    /* Places whole fleet of player randomly (from game generator). If AI of player learned where
+    human players hit first, the fleet which lies least there is kept of LEARN_FLEETS random fleets */
+
+    PLAYER* owner = &game->session.players[player];
+    const uint32_t* avoid = game->ai[player].avoid;
+    placement_of_ships_computer(owner, &game->session.rng, game->board_size);
+    game->placed[player] = 1;
+    if (!avoid) return;
+
+    PLAYER best = *owner;
+    BOARD best_board = *owner->player_board;
+    uint64_t best_heat = fleet_heat(owner, avoid, game->board_size);
+    for (int i = 1; i < LEARN_FLEETS; ++i) {
+        placement_of_ships_computer(owner, &game->session.rng, game->board_size);
+        uint64_t heat = fleet_heat(owner, avoid, game->board_size);
+        if (heat < best_heat) {
+            best = *owner;
+            best_board = *owner->player_board;
+            best_heat = heat;
+        }
     }
-    return 0;
+    *owner = best;      // board pointer stays the same
+    *owner->player_board = best_board;
 }
 
 
-_COORD get_coord() {
-    /* Asks user for coordinates to shoots at and returns them as struct */
+void game_finish_placement(GAME* game, int player) {
+    /* Player placed all his ships (with game_place_ship) - his fleet is ready */
 
-    printf(DEFAULT_COLOR"\n\n\tAhoy! Give us position to shoot at (e.g. A6): ");
-    _COORD result = NULL_COORD;    // default coordinates are too big so formatting error will be detected
-    char buffer[8];
-    fgets(buffer, 8, stdin);
-    result.x = strtol(buffer + 1, NULL, 10) - 1;   // reading coordinates
-    buffer[0] = toupper(buffer[0]);
-    result.y = buffer[0] - 'A';
-    return result;
+    game->placed[player] = 1;
 }
 
 
-int fire(PLAYER player_opponent, _COORD aim, unsigned int board_size) {
-    /* Checks whether given coordinates are valid (within board, repetitive strikes). If not, INVALID is returned.
-    If shot hits water, VALID_MISS is returned and VALID_HIT is returned upon hitting ship. Function edits the board */
+void game_begin(GAME* game) {
+    /* Called when both fleets are placed. Both AIs get their generators from game generator
+    and first player is on turn */
 
-    // checks if within board
-    if (aim.x < 0 || aim.x >= board_size) return INVALID;
-    if (aim.y < 0 || aim.y >= board_size) return INVALID;
-    // actually fire
-    if (player_opponent.player_board[aim.x][aim.y] == DEFAULT) {
-        player_opponent.player_board[aim.x][aim.y] = MISS;  // hits water
-        return VALID_MISS;
-    }
-    else if (player_opponent.player_board[aim.x][aim.y] == PLACED_SHIP) {
-        player_opponent.player_board[aim.x][aim.y] = HIT;  // hits ship
-        return VALID_HIT;
-    }
-    else return INVALID;    // shoots where it is not allowed (repetitive strikes)
+    seed_random(&game->ai[0].rng, next_random(&game->session.rng), 0);
+    seed_random(&game->ai[1].rng, next_random(&game->session.rng), 1);
+    game->turn = 0;
+    game->phase = PHASE_SHOOTING;
 }
 
 
-int ship_hit_check(PLAYER player_opponent) {
-    /* Called when player hits something and checks whether it was deadly strike. Function goes through all
-    enemy ships. If it finds ship with all tiles set to HIT, it returns 1. Else 0 is returned */
+int game_step(GAME* game) {
+    /* Makes one move of the game which needs no input - placement of computer's fleet, start of the game when
+    both fleets are ready or shot of computer on turn. Never waits for anything, so one thread can step many
+    games in turns. Fleets are placed in order of players (the same random numbers as without stepping).
+    Returns 1 if game moved, 0 if it awaits input of human (game_awaits) or is finished */
 
-    int flag = 0;
-    // check Carrier
-    for (int i = 0; i < 5; ++i)
-        if (*player_opponent.carrier[i] != HIT) {
-            flag++;
-            break;  // not all of them HIT
-        }
-    if (flag == 0) {    // newly sunk ship found (all tiles were HIT)
-        for (int i = 0; i < 5; ++i) *player_opponent.carrier[i] = SUNK; // sinks the ship
-        return 1;
-    }
-    flag = 0;
-    // check Battleship
-    for (int i = 0; i < 4; ++i)
-        if (*player_opponent.battleship[i] != HIT) {
-            flag++;
-            break;  // not all of them HIT
-        }
-    if (flag == 0) {    // newly sunk ship found
-        for (int i = 0; i < 4; ++i) *player_opponent.battleship[i] = SUNK;
-        return 1;
-    }
-    flag = 0;
-    // check Destroyer
-    for (int i = 0; i < 3; ++i)
-        if (*player_opponent.destroyer[i] != HIT) {
-            flag++;
-            break;  // not all of them HIT
+    if (game->phase == PHASE_PLACEMENT) {
+        for (int player = 0; player < 2; ++player) {
+            if (game->placed[player] || game->ai_level[player] == AI_NONE) continue;
+            game_place_random(game, player);
+            return 1;
         }
-    if (flag == 0) {    // newly sunk ship found
-        for (int i = 0; i < 3; ++i) *player_opponent.destroyer[i] = SUNK;
+        if (!game->placed[0] || !game->placed[1]) return 0;     // human is placing
+        game_begin(game);
         return 1;
     }
-    flag = 0;
-    // check Submarine
-    for (int i = 0; i < 3; ++i)
-        if (*player_opponent.submarine[i] != HIT) {
-            flag++;
-            break;  // not all of them HIT
-        }
-    if (flag == 0) {    // newly sunk ship found
-        for (int i = 0; i < 3; ++i) *player_opponent.submarine[i] = SUNK;
+    if (game->phase == PHASE_SHOOTING && game->ai_level[game->turn] != AI_NONE) {
+        computer_shot(game);
         return 1;
     }
-    flag = 0;
-    // check Patrol Boat
-    for (int i = 0; i < 2; ++i)
-        if (*player_opponent.patrol_boat[i] != HIT) {
-            flag++;
-            break;  // not all of them HIT
+    return 0;
+}
+
+
+int game_phase(GAME* game) {
+    /* Returns PHASE_PLACEMENT, PHASE_SHOOTING or PHASE_FINISHED */
+
+    return game->phase;
+}
+
+
+int game_awaits(GAME* game) {
+    /* Returns player whose move the game awaits - the first one without fleet or the one on turn.
+    NO_PLAYER when the game is finished */
+
+    if (game->phase == PHASE_FINISHED) return NO_PLAYER;
+    if (game->phase == PHASE_PLACEMENT) return game->placed[0] ? 1 : 0;
+    return game->turn;
+}
+
+
+SHOT game_fire(GAME* game, _COORD aim) {
+    /* Player on turn fires at opponent's board. INVALID shot changes nothing. Otherwise AI of the
+    player learns the result and opponent is on turn, unless this shot won the game - then the game
+    is recorded (if it has an archive). Shots before game_begin or after the end are INVALID */
+
+    int player = game->turn;
+    SHOT shot = {INVALID, NO_SHIP, 0};
+    if (game->phase != PHASE_SHOOTING) return shot;     // fleets are not placed yet or game is over
+
+    shot = game->kernels->fire(&game->session.players[!player], aim);
+    if (shot.flag == INVALID) return shot;
+
+    int tile = tile_index(aim.x, aim.y, game->board_size);
+    game->session.players[player].last_shot = tile;
+    game->shots[game->shot_count++] = tile;
+    if (game->ai_level[player] != AI_NONE) game->kernels->observe(&game->ai[player], &game->session.players[!player], aim, shot);
+    if (shot.victory) {
+        game->winner = player;
+        game->phase = PHASE_FINISHED;
+        if (game->archive) archive_game(game);
+    }
+    else game->turn = !player;
+    return shot;
+}
+
+
+int game_record(GAME* game, _COORD aim, int flag, SHIP* sunk) {
+    /* Records result of shot of player on turn which was resolved outside of the game (e.g. by referee of bot
+    protocol). Opponent's board is only what player knows - HIT, MISS and SUNK tiles. Sunk ship (NULL if nothing
+    sank) takes place of first afloat ship of its size. Turn does not change. Returns 1 if result contradicts
+    what is known, else 0 */
+
+    int player = game->turn;
+    unsigned int board_size = game->board_size;
+    PLAYER* opponent = &game->session.players[!player];
+    BOARD* board = opponent->player_board;
+    SHOT shot = {flag, NO_SHIP, 0};
+
+    if (aim.x >= board_size || aim.y >= board_size) return 1;
+    int tile = tile_index(aim.x, aim.y, board_size);
+    if (tile_shot(board, tile)) return 1;   // repetitive strike
+
+    if (flag == VALID_MISS) bit_set(board->misses, tile);
+    else if (flag == VALID_HIT && !sunk) bit_set(board->hits, tile);
+    else if (flag == VALID_HIT) {
+        int id = 0;
+        while (id < opponent->fleet_size && (opponent->ships[id].size != sunk->size || opponent->ships[id].hits)) id++;
+        if (id == opponent->fleet_size) return 1;   // no afloat ship of this size
+        if (sunk->x >= board_size || sunk->y >= board_size) return 1;
+        if ((sunk->orientation == HORIZONTAL ? sunk->x : sunk->y) + sunk->size > (int)board_size) return 1;
+
+        FLEET_SHIP ship = opponent->ships[id];
+        ship.origin = tile_index(sunk->x, sunk->y, board_size);
+        ship.orientation = sunk->orientation;
+        int covers_aim = 0;
+        for (int i = 0; i < ship.size; ++i) {   // every other tile of the ship has to be HIT already
+            int ship_tile_index = ship_tile(&ship, i, board_size);
+            if (ship_tile_index == tile) covers_aim = 1;
+            else if (!bit_get(board->hits, ship_tile_index)) return 1;
+        }
+        if (!covers_aim) return 1;
+
+        ship.hits = (1 << ship.size) - 1;
+        opponent->ships[id] = ship;
+        for (int i = 0; i < ship.size; ++i) {
+            int ship_tile_index = ship_tile(&ship, i, board_size);
+            bit_clear(board->hits, ship_tile_index);
+            bit_set(board->sunk, ship_tile_index);
+        }
+        shot.sunk = id;
+    }
+    else return 1;
+
+    game->session.players[player].last_shot = tile;
+    if (game->ai_level[player] != AI_NONE) ai_observe(&game->ai[player], opponent, aim, shot, board_size);
+    return 0;
+}
+
+
+_COORD game_ai_move(GAME* game) {
+    /* Returns tile chosen by AI of player on turn (player must be played by AI). Game is not changed. If the
+    move was speculated, only its result is taken */
+
+    int player = game->turn;
+    speculation_join(game);
+    if (game->speculation_ready && game->speculated_player == player) {
+        game->speculation_ready = 0;
+        COUNT(speculated_moves);
+        return game->speculated;
+    }
+    return calculate_shot(&game->session.players[!player], game->board_size, &game->ai[player]);
+}
+
+
+void game_speculate(GAME* game) {
+    /* Starts computing next move of AI of the player who is not on turn on background thread, while player on
+    turn thinks (e.g. human types coordinates). Shots of player on turn do not change anything AI knows, so the
+    move is the same as if it was computed after them - game_ai_move only takes it. Monte Carlo AI samples
+    until the other player moves (up to SPECULATION_STRETCH budgets, at least one). Without threads the move
+    is computed when it is needed */
+
+#ifdef HAS_THREADS
+    int player = !game->turn;
+    if (game->speculating || game->speculation_ready || game->winner != NO_PLAYER || game->ai_level[player] == AI_NONE) return;
+
+    AI* ai = &game->ai[player];
+    atomic_store(&ai->hurry, 0);
+    ai->speculative = 1;
+    game->speculated_player = player;
+    if (thrd_create(&game->speculation, speculation_thread, game) == thrd_success) game->speculating = 1;
+    else ai->speculative = 0;   // computed later in game_ai_move
+#endif
+}
+
+
+void speculation_join(GAME* game) {
+    /* Waits for speculation to finish (search is hurried first) - its move is kept until game_ai_move
+    takes it. Nothing happens if none runs */
+
+#ifdef HAS_THREADS
+    if (!game->speculating) return;
+    AI* ai = &game->ai[game->speculated_player];
+    atomic_store(&ai->hurry, 1);
+    thrd_join(game->speculation, NULL);
+    ai->speculative = 0;
+    game->speculating = 0;
+    game->speculation_ready = 1;
+#endif
+}
+
+
+#ifdef HAS_THREADS
+int speculation_thread(void* arg) {
+    /* Body of speculation thread. Reads only what AI of speculated player knows (opponent's board) and
+    writes only its AI and result */
+
+    GAME* game = (GAME*) arg;
+    int player = game->speculated_player;
+    game->speculated = calculate_shot(&game->session.players[!player], game->board_size, &game->ai[player]);
+    return 0;
+}
+#endif
+
+
+char game_tile(GAME* game, int player, _COORD coord) {
+    /* Returns sign of tile of player's board (as player sees it), or 0 if it lies outside board */
+
+    if (coord.x >= game->board_size || coord.y >= game->board_size) return 0;
+    return tile_state(game->session.players[player].player_board, tile_index(coord.x, coord.y, game->board_size));
+}
+
+
+int game_winner(GAME* game) {
+    /* Returns player who destroyed opponent's fleet, or NO_PLAYER while game goes on */
+
+    return game->winner;
+}
+
+
+void game_set_archive(GAME* game, ARCHIVE* archive) {
+    /* Every game finished from now on is recorded to archive (NULL stops recording). Records are
+    collected in game's own buffer and written in chunks, so more games can share one archive */
+
+    game_flush_archive(game);
+    game->archive = archive;
+    if (archive && !game->archive_buffer) game->archive_buffer = (unsigned char*) malloc(ARCHIVE_BUFFER);
+}
+
+
+void game_flush_archive(GAME* game) {
+    /* Writes records collected in game's buffer to its archive */
+
+    if (game->archive && game->archive_used) archive_write(game->archive, game->archive_buffer, game->archive_used);
+    game->archive_used = 0;
+}
+
+
+///////////////////////////////////////////////////
+/////////////////// GAME RECORDS //////////////////
+///////////////////////////////////////////////////
+
+
+ARCHIVE* archive_open(const char* path) {
+    /* Opens record file for appending (new file gets ARCHIVE_MAGIC). Records are never changed
+    once written. Returns NULL if file cannot be opened or is not a record file */
+
+    char magic[sizeof(ARCHIVE_MAGIC)] = "";
+    FILE* file = fopen(path, "rb");
+    if (file) {
+        size_t length = fread(magic, 1, sizeof(magic), file);
+        fclose(file);
+        if (length && (length != sizeof(magic) || memcmp(magic, ARCHIVE_MAGIC, sizeof(magic)))) return NULL;
+    }
+
+    file = fopen(path, "ab");
+    if (!file) return NULL;
+    setvbuf(file, NULL, _IONBF, 0);     // chunks are buffered by games
+    fseek(file, 0, SEEK_END);
+    if (ftell(file) == 0) fwrite(ARCHIVE_MAGIC, 1, sizeof(ARCHIVE_MAGIC), file);
+
+    ARCHIVE* archive = (ARCHIVE*) malloc(sizeof(ARCHIVE));
+    archive->file = file;
+#ifdef HAS_THREADS
+    mtx_init(&archive->lock, mtx_plain);
+#endif
+    return archive;
+}
+
+
+void archive_close(ARCHIVE* archive) {
+    /* Closes record file. Games using the archive have to be flushed (or freed) before */
+
+    fclose(archive->file);
+#ifdef HAS_THREADS
+    mtx_destroy(&archive->lock);
+#endif
+    free(archive);
+}
+
+
+void archive_write(ARCHIVE* archive, const unsigned char* data, size_t size) {
+    /* Appends chunk of whole records - chunks of different threads never mix */
+
+#ifdef HAS_THREADS
+    mtx_lock(&archive->lock);
+#endif
+    fwrite(data, 1, size, archive->file);
+#ifdef HAS_THREADS
+    mtx_unlock(&archive->lock);
+#endif
+}
+
+
+void archive_game(GAME* game) {
+    /* Packs finished game to game's buffer (buffer is written first when the record might not fit). Record:
+    length (2 bytes), board size, fleet count, AI levels (+1, 4 bits each), winner, number of shots (2), seed (8),
+    stream (8), then class | orientation << 7 and origin (2) of each ship of both players and tiles of all
+    shots (1 byte each on boards up to 16x16, else 2). Multi-byte numbers are little-endian. Fleets and shots
+    are enough to replay the game */
+
+    if (game->archive_used + MAX_RECORD > ARCHIVE_BUFFER) game_flush_archive(game);
+
+    unsigned int board_size = game->board_size;
+    int shot_bytes = board_size * board_size <= 256 ? 1 : 2;
+    unsigned char* record = game->archive_buffer + game->archive_used;
+    unsigned char* data = record + RECORD_HEADER;
+
+    record[2] = board_size;
+    record[3] = game->session.fleet.count;
+    record[4] = (game->ai_level[0] + 1) | (game->ai_level[1] + 1) << 4;
+    record[5] = game->winner;
+    put_bytes(record + 6, game->shot_count, 2);
+    put_bytes(record + 8, game->seed, 8);
+    put_bytes(record + 16, game->stream, 8);
+
+    for (int player = 0; player < 2; ++player) {
+        PLAYER* owner = &game->session.players[player];
+        for (int id = 0; id < owner->fleet_size; ++id) {
+            data[0] = owner->ships[id].ship_class | owner->ships[id].orientation << 7;
+            put_bytes(data + 1, owner->ships[id].origin, 2);
+            data += 3;
+        }
+    }
+    for (int i = 0; i < game->shot_count; ++i) {
+        put_bytes(data, game->shots[i], shot_bytes);
+        data += shot_bytes;
+    }
+
+    put_bytes(record, data - record, 2);
+    game->archive_used += data - record;
+}
+
+
+static inline void put_bytes(unsigned char* data, uint64_t value, int bytes) {
+    /* Stores lowest bytes of value in little-endian order (same file on every machine) */
+
+    for (int i = 0; i < bytes; ++i) data[i] = (unsigned char)(value >> 8*i);
+}
+
+
+static inline uint64_t get_bytes(const unsigned char* data, int bytes) {
+    /* Reads little-endian number of given size */
+
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; ++i) value |= (uint64_t)data[i] << 8*i;
+    return value;
+}
+
+
+int records_open(RECORDS* records, const char* path) {
+    /* Makes whole record file accessible in memory - memory map where it exists, else the file is read
+    into allocated memory. Records are then only viewed in place (records_next). Returns 1 if file cannot
+    be read or is not a record file, else 0 */
+
+    records->data = NULL;
+    records->size = 0;
+    records->mapped = 0;
+#ifdef HAS_MMAP
+    int descriptor = open(path, O_RDONLY);
+    if (descriptor < 0) return 1;
+    struct stat info;
+    if (fstat(descriptor, &info) == 0 && info.st_size > 0) {
+        void* data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+        if (data != MAP_FAILED) {
+            records->data = (unsigned char*) data;
+            records->size = info.st_size;
+            records->mapped = 1;
+        }
+    }
+    close(descriptor);
+#endif
+    if (!records->mapped) {     // no mmap - fread
+        FILE* file = fopen(path, "rb");
+        if (!file) return 1;
+        fseek(file, 0, SEEK_END);
+        long size = ftell(file);
+        fseek(file, 0, SEEK_SET);
+        if (size > 0) {
+            records->data = (unsigned char*) malloc(size);
+            if (records->data) records->size = fread(records->data, 1, size, file);
+        }
+        fclose(file);
+    }
+
+    if (records->size < sizeof(ARCHIVE_MAGIC) || memcmp(records->data, ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC))) {
+        records_close(records);
+        return 1;
+    }
+    return 0;
+}
+
+
+void records_close(RECORDS* records) {
+    /* Releases memory of record file */
+
+#ifdef HAS_MMAP
+    if (records->mapped) munmap(records->data, records->size);
+    else free(records->data);
+#else
+    free(records->data);
+#endif
+    records->data = NULL;
+    records->size = 0;
+}
+
+
+size_t records_next(RECORDS* records, size_t offset, RECORD* record) {
+    /* Fills view of record at given offset (0 = first record). Returns offset of the next record, or 0
+    at the end of file or when the record is damaged (e.g. cut by crash of writer) */
+
+    if (offset == 0) offset = sizeof(ARCHIVE_MAGIC);
+    if (offset + RECORD_HEADER > records->size) return 0;
+
+    const unsigned char* data = records->data + offset;
+    size_t length = get_bytes(data, 2);
+    if (length < RECORD_HEADER || offset + length > records->size) return 0;
+
+    record->board_size = data[2];
+    record->fleet_count = data[3];
+    record->ai_level[0] = (data[4] & 15) - 1;
+    record->ai_level[1] = (data[4] >> 4) - 1;
+    record->winner = data[5];
+    record->shot_count = get_bytes(data + 6, 2);
+    record->shot_bytes = record->board_size * record->board_size <= 256 ? 1 : 2;
+    record->seed = get_bytes(data + 8, 8);
+    record->stream = get_bytes(data + 16, 8);
+    record->ships = data + RECORD_HEADER;
+    record->shots = record->ships + 2 * 3 * record->fleet_count;
+    if (record->shots + record->shot_count * record->shot_bytes != data + length) return 0;
+    return offset + length;
+}
+
+
+static inline int record_shot(const RECORD* record, unsigned int i) {
+    /* Returns tile of i-th shot of record (players alternate, player 0 fires first) */
+
+    if (record->shot_bytes == 1) return record->shots[i];
+    return record->shots[2*i] | record->shots[2*i + 1] << 8;
+}
+
+
+SHIP record_ship(const RECORD* record, int player, int id) {
+    /* Returns ship with given id of player's fleet from record. Its class has to be known (below CLASS_COUNT) -
+    records from file are checked by analyze_record first */
+
+    const unsigned char* data = record->ships + 3 * (player * record->fleet_count + id);
+    int tile = data[1] | data[2] << 8;
+    SHIP ship = {data[0] >> 7, SHIP_CLASSES[data[0] & 127].size, tile % record->board_size, tile / record->board_size};
+    return ship;
+}
+
+
+int scan_records(const char* path) {
+    /* Reads all records of file and prints their summary - number of games, shots and bytes, average
+    shots needed to win and speed of reading. Returns exit code of program */
+
+    RECORDS records;
+    if (records_open(&records, path)) {
+        fprintf(stderr, "%s is not a file of game records\n", path);
+        return 1;
+    }
+
+    double start = wall_time();
+    unsigned long games = 0;
+    unsigned long long shots = 0, winner_shots = 0;
+    RECORD record;
+    size_t offset = 0, end = sizeof(ARCHIVE_MAGIC);
+    while ((offset = records_next(&records, offset, &record))) {
+        games++;
+        shots += record.shot_count;
+        winner_shots += (record.shot_count + !record.winner) / 2;     // player 0 fires first
+        end = offset;
+    }
+    double seconds = wall_time() - start;
+
+    printf("records:         %lu\n", games);
+    printf("shots:           %llu\n", shots);
+    printf("bytes:           %zu\n", records.size);
+    if (games) printf("bytes/game:      %.1f\n", (double)(records.size - sizeof(ARCHIVE_MAGIC)) / games);
+    if (games) printf("avg shots (win): %.2f\n", (double)winner_shots / games);
+    printf("seconds:         %.3f\n", seconds);
+    if (end != records.size) printf("damaged tail:    %zu bytes\n", records.size - end);
+    records_close(&records);
+    return 0;
+}
+
+
+///////////////////////////////////////////////////
+//////////////////// ANALYSIS /////////////////////
+///////////////////////////////////////////////////
+
+
+ANALYSIS* analyze_records(const char* path, int threads) {
+    /* Replays all records of file and collects per board size: first hits and fleets of human and computer
+    players per tile and histograms of shots needed to win per level of winner. Record boundaries are found
+    first (only lengths are read) and cut to chunks of ANALYSIS_CHUNK records, which threads take one by one -
+    file is mapped, so it is read from disk once and never held whole in own memory. Each thread has its own
+    statistics, which are added up at the end. Returns NULL if file cannot be read (caller frees result) */
+
+    RECORDS records;
+    if (records_open(&records, path)) return NULL;
+
+    size_t capacity = 64, count = 0, offset = 0, end = sizeof(ARCHIVE_MAGIC);
+    size_t* chunks = (size_t*) malloc(sizeof(size_t) * capacity);
+    unsigned long record_count = 0;
+    RECORD record;
+    while ((offset = records_next(&records, offset, &record))) {
+        if (record_count++ % ANALYSIS_CHUNK == 0) {
+            if (count + 2 > capacity) chunks = (size_t*) realloc(chunks, sizeof(size_t) * (capacity *= 2));
+            chunks[count++] = end;      // start of this record
+        }
+        end = offset;
+    }
+    chunks[count] = end;    // end of last chunk
+
+    if (threads > MAX_THREADS) threads = MAX_THREADS;
+    if ((size_t)threads > count) threads = count ? count : 1;
+    _Atomic size_t next;
+    atomic_init(&next, 0);
+    ANALYSIS_WORKER workers[MAX_THREADS];
+    for (int i = 0; i < threads; ++i) {
+        workers[i].records = &records;
+        workers[i].chunks = chunks;
+        workers[i].chunk_count = count;
+        workers[i].next = &next;
+        workers[i].result = (ANALYSIS*) calloc(1, sizeof(ANALYSIS));
+    }
+
+#ifdef HAS_THREADS
+    thrd_t thread[MAX_THREADS];
+    for (int i = 1; i < threads; ++i) thrd_create(&thread[i], analysis_worker, &workers[i]);
+    analysis_worker(&workers[0]);   // main thread works too
+    for (int i = 1; i < threads; ++i) thrd_join(thread[i], NULL);
+#else
+    for (int i = 0; i < threads; ++i) analysis_worker(&workers[i]);
+#endif
+
+    ANALYSIS* analysis = workers[0].result;     // merging results
+    uint32_t* total = (uint32_t*) analysis->boards;
+    size_t words = (MAX_BOARD + 1) * sizeof(BOARD_STATS) / sizeof(uint32_t);   // BOARD_STATS holds only counters
+    for (int i = 1; i < threads; ++i) {
+        uint32_t* part = (uint32_t*) workers[i].result->boards;
+        for (size_t j = 0; j < words; ++j) total[j] += part[j];
+        analysis->skipped += workers[i].result->skipped;
+        free(workers[i].result);
+    }
+    analysis->records = record_count;
+    analysis->damaged = records.size - end;
+
+    free(chunks);
+    records_close(&records);
+    return analysis;
+}
+
+
+int analysis_worker(void* arg) {
+    /* Body of one analysis thread. Takes chunks of records until there is none left */
+
+    ANALYSIS_WORKER* worker = (ANALYSIS_WORKER*) arg;
+    size_t chunk;
+    while ((chunk = atomic_fetch_add(worker->next, 1)) < worker->chunk_count) {
+        RECORD record;
+        size_t offset = worker->chunks[chunk];
+        while (offset < worker->chunks[chunk + 1] && (offset = records_next(worker->records, offset, &record))) {
+            worker->result->skipped += analyze_record(worker->result, &record);
+        }
+    }
+    return 0;
+}
+
+
+int analyze_record(ANALYSIS* analysis, const RECORD* record) {
+    /* Replays one record - fleets are put to bit-planes and each shot is checked against the fleet of
+    the opponent. Records which cannot come from this program (e.g. bigger boards, unknown classes of
+    ships, ships or shots off the board) are skipped - everything is checked before anything is counted.
+    Returns 1 if record was skipped, else 0 */
+
+    unsigned int board_size = record->board_size;
+    if (board_size < 5 || board_size > MAX_BOARD || record->fleet_count > MAX_FLEET || record->winner > 1) return 1;
+
+    int tiles = board_size * board_size;
+    uint64_t fleet[2][BOARD_WORDS] = {{0}};
+    int first_hit[2] = {-1, -1};
+    int class[2];
+
+    for (int player = 0; player < 2; ++player) {
+        for (int id = 0; id < (int)record->fleet_count; ++id) {
+            const unsigned char* data = record->ships + 3 * (player * record->fleet_count + id);
+            if ((data[0] & 127) >= CLASS_COUNT) return 1;   // unknown class of ship
+            if ((data[1] | data[2] << 8) >= tiles) return 1;    // origin off the board
+            SHIP ship = record_ship(record, player, id);
+            if (ship.x >= board_size || ship.y >= board_size) return 1;
+            if ((ship.orientation == HORIZONTAL ? ship.x : ship.y) + ship.size > (int)board_size) return 1;
+        }
+    }
+    for (unsigned int i = 0; i < record->shot_count; ++i) {
+        if (record_shot(record, i) >= tiles) return 1;
+    }
+
+    BOARD_STATS* stats = &analysis->boards[board_size];
+    for (int player = 0; player < 2; ++player) {
+        class[player] = record->ai_level[player] != AI_NONE;
+        stats->players[class[player]]++;
+        for (int id = 0; id < (int)record->fleet_count; ++id) {
+            SHIP ship = record_ship(record, player, id);
+            int step = ship.orientation == HORIZONTAL ? 1 : board_size;
+            for (int i = 0; i < ship.size; ++i) {
+                int tile = tile_index(ship.x, ship.y, board_size) + i*step;
+                bit_set(fleet[player], tile);
+                stats->fleet[class[player]][tile]++;
+            }
+        }
+    }
+
+    for (unsigned int i = 0; i < record->shot_count; ++i) {
+        int player = i & 1;     // players alternate, player 0 fires first
+        int tile = record_shot(record, i);
+        if (first_hit[player] < 0 && bit_get(fleet[!player], tile)) {
+            first_hit[player] = tile;
+            stats->first_hits[class[player]][tile]++;
+        }
+    }
+
+    int level = record->ai_level[record->winner] + 1;
+    unsigned int shots = (record->shot_count + !record->winner) / 2;   // fired by the winner
+    if (level > AI_LEVELS) level = AI_LEVELS;
+    stats->wins[level][shots < MAX_SHOTS ? shots : MAX_SHOTS]++;
+    stats->games++;
+    return 0;
+}
+
+
+void print_analysis(ANALYSIS* analysis, double seconds) {
+    /* Prints statistics as JSON. For each board size with games: per level of winner number of wins, average
+    shots and histogram; per class of player probability of first hit and of ship on each tile (row by row) */
+
+    printf("{\n  \"records\": %lu,\n  \"skipped_records\": %lu,\n  \"damaged_bytes\": %zu,\n  \"seconds\": %.3f,\n  \"boards\": [",
+           analysis->records, analysis->skipped, analysis->damaged, seconds);
+    int first = 1;
+    for (unsigned int board_size = 5; board_size <= MAX_BOARD; ++board_size) {
+        BOARD_STATS* stats = &analysis->boards[board_size];
+        if (!stats->games) continue;
+
+        printf("%s\n    {\"size\": %u, \"games\": %u,\n     \"wins\": {", first ? "" : ",", board_size, stats->games);
+        first = 0;
+        int first_level = 1;
+        for (int level = 0; level <= AI_LEVELS; ++level) {
+            unsigned long games = 0, shots = 0;
+            for (int i = 0; i <= MAX_SHOTS; ++i) {
+                games += stats->wins[level][i];
+                shots += (unsigned long)i * stats->wins[level][i];
+            }
+            if (!games) continue;
+
+            printf("%s\"%s\": {\"games\": %lu, \"avg_shots\": %.2f, \"histogram\": {", first_level ? "" : ", ", AI_NAMES[level], games, (double)shots / games);
+            first_level = 0;
+            int first_bucket = 1;
+            for (int i = 0; i <= MAX_SHOTS; ++i) {
+                if (!stats->wins[level][i]) continue;
+                printf("%s\"%d\": %u", first_bucket ? "" : ", ", i, stats->wins[level][i]);
+                first_bucket = 0;
+            }
+            printf("}}");
+        }
+        printf("}");
+
+        for (int map = 0; map < 2; ++map) {
+            printf(",\n     \"%s\": {", map ? "ship_probability" : "first_hit_probability");
+            int first_class = 1;
+            for (int class = 0; class < 2; ++class) {
+                if (!stats->players[class]) continue;
+                const uint32_t* counts = map ? stats->fleet[class] : stats->first_hits[class];
+                printf("%s\"%s\": [", first_class ? "" : ", ", class ? "computer" : "human");
+                first_class = 0;
+                for (unsigned int tile = 0; tile < board_size * board_size; ++tile) {
+                    printf("%s%.4f", tile == 0 ? "" : tile % board_size ? ", " : ",\n       ", (double)counts[tile] / stats->players[class]);
+                }
+                printf("]");
+            }
+            printf("}");
+        }
+        printf("}");
+    }
+    printf("\n  ]\n}\n");
+}
+
+
+void game_set_learned(GAME* game, int player, const ANALYSIS* analysis) {
+    /* AI of player uses statistics of recorded human players on board of this game - it prefers tiles where
+    humans place ships and places own fleet away from tiles humans hit first. Nothing changes when there are
+    not enough recorded games. Has to be called after game_set_ai */
+
+    AI* ai = &game->ai[player];
+    ai->prior = NULL;
+    ai->avoid = NULL;
+    if (!analysis) return;
+
+    const BOARD_STATS* stats = &analysis->boards[game->board_size];
+    if (stats->players[0] < LEARN_MIN_GAMES) return;
+    ai->prior = stats->fleet[0];
+    ai->avoid = stats->first_hits[0];
+}
+
+
+void learned_weights(AI* ai, unsigned int weight[], unsigned int board_size) {
+    /* Multiplies weights by 1 (tile where recorded humans never had a ship) up to 2 (tile with
+    the most ships) */
+
+    uint32_t most = 1;
+    for (unsigned int tile = 0; tile < board_size * board_size; ++tile) if (ai->prior[tile] > most) most = ai->prior[tile];
+    for (unsigned int tile = 0; tile < board_size * board_size; ++tile) {
+        weight[tile] = (uint64_t)weight[tile] * (LEARN_SCALE + (uint64_t)LEARN_SCALE * ai->prior[tile] / most) / LEARN_SCALE;
+    }
+}
+
+
+uint64_t fleet_heat(PLAYER* player, const uint32_t* heat, unsigned int board_size) {
+    /* Returns sum of heat over all tiles of player's fleet */
+
+    uint64_t sum = 0;
+    for (int id = 0; id < player->fleet_size; ++id) {
+        for (int i = 0; i < player->ships[id].size; ++i) sum += heat[ship_tile(&player->ships[id], i, board_size)];
+    }
+    return sum;
+}
+
+
+///////////////////////////////////////////////////
+///////////////////// GAMEPLAY ////////////////////
+///////////////////////////////////////////////////
+
+
+void player_vs_player(GAME* game, unsigned int board_size) {
+    /* PvP mode. Game is started again in place and played in console until one player destroys all enemy
+    ships. Game memory is reused by next game */
+
+    game_start(game, board_size, time(NULL), 0);
+    console_game(game);
+}
+
+
+void player_vs_computer(GAME* game, unsigned int board_size, int ai_level) {
+    /* PvCPU mode. Game is started again in place, second player is played by AI (of given level) and the
+    game is played in console until one destroys all enemy ships. Random seed is taken from time here.
+    Game memory is reused by next game */
+
+    game_start(game, board_size, time(NULL), 0);
+    game_set_ai(game, 1, ai_level);
+    game_set_search(game, 1, search_budget, search_samples, cpu_count());   // human waits - all cores sample
+    game_set_learned(game, 1, learned);
+    console_game(game);
+}
+
+
+void console_game(GAME* game) {
+    /* Plays started game in console. Game is stepped while computers can move, and the console only asks
+    human players for what the game awaits - placement of fleet or shot. While human types, computer thinks
+    about its next shot. When computer wins, 'lost screen' is printed from human's perspective */
+
+    while (1) {
+        while (game_step(game));    // computer players move
+        int player = game_awaits(game);
+        if (player == NO_PLAYER) break;     // finished
+
+        if (game_phase(game) == PHASE_PLACEMENT) {
+            placement_of_ships_user(game, player);
+            game_finish_placement(game, player);
+        }
+        else {
+            game_speculate(game);   // computer thinks about its next shot while player types
+            player_turn(game);
+        }
+    }
+
+    int winner = game_winner(game);
+    if (game->ai_level[winner] != AI_NONE) {
+        // human is the opponent - his board goes first
+        default_screen(&game->session.players[!winner], &game->session.players[winner], game->board_size);
+        printf(BRIGHT_RED_COLOR"\n\t###################################\n");
+        printf("\t###################################\n");
+        printf("\t     ------- YOU LOST! -------\n");
+        printf("\t###################################\n");
+        printf("\t###################################\n");
+    }
+    printf(DEFAULT_COLOR"\n\tCongratulations! You just won ");
+    printf(UNDERLINE_COLOR"3 points.\n"DEFAULT_COLOR);
+}
+
+
+int player_turn(GAME* game) {
+    /* Player on turn sees boards from his perspective and is asked for coordinates to shoot at. This is
+    repeated until valid coordinates are passed. If the shot destroyed opponent's fleet, victory screen
+    is printed and returns 1. Else returns 0 */
+
+    PLAYER* player_active = &game->session.players[game->turn];
+    PLAYER* player_opponent = &game->session.players[!game->turn];
+    unsigned int board_size = game->board_size;
+    _COORD aim;
+    SHOT shot;
+
+    default_screen(player_active, player_opponent, board_size);
+    TIMER_START(start);
+    aim = get_coord();
+    shot = game_fire(game, aim);
+    while(shot.flag == INVALID) {    // repeats until valid coordinates are given
+        COUNT(invalid_player);
+        printf(UNDERLINE_COLOR"\n\tInvalid shot Captain!");
+        aim = get_coord();
+        shot = game_fire(game, aim);
+    }
+    TIMER_STOP(player_turns, start);
+
+    if (shot.victory) {  // victory screen
+        default_screen(player_active, player_opponent, board_size);
+        printf(BRIGHT_RED_COLOR"\n\t##################################\n");
+        printf("\t##################################\n");
+        printf("\t  ------- VICTORY %s -------\n", player_active->nick);
+        printf("\t##################################\n");
+        printf("\t##################################\n");
+        return 1;
+    }
+    return 0;
+}
+
+
+_COORD get_coord() {
+    /* Asks user for coordinates to shoots at and returns them as struct */
+
+    printf(DEFAULT_COLOR"\n\n\tAhoy! Give us position to shoot at (e.g. A6): ");
+    _COORD result;
+    char buffer[16] = "";   // stays empty when input ends
+    fgets(buffer, 16, stdin);
+    parse_coord(buffer, &result);   // formatting error gives NULL_COORD, which is out of every board
+    return result;
+}
+
+
+int parse_coord(const char* text, _COORD* result) {
+    /* Reads coordinates like 'A6' or 'ab1200' - row letters followed by column number. Rows are named
+    like columns of spreadsheet (A..Z, AA..AZ, BA, ...). Returns 0 on success, otherwise 1 and NULL_COORD */
+
+    _COORD null_coord = NULL_COORD;
+    unsigned long row = 0, column;
+    int letters = 0;
+
+    *result = null_coord;
+    while (isalpha((unsigned char)*text) && letters < 4) {   // 4 letters are more than enough for MAX_LARGE_BOARD
+        row = row * 26 + (toupper((unsigned char)*text) - 'A' + 1);
+        text++;
+        letters++;
+    }
+    if (letters == 0 || !isdigit((unsigned char)*text)) return 1;
+    column = strtoul(text, NULL, 10);
+    if (column == 0 || column > MAX_LARGE_BOARD || row > MAX_LARGE_BOARD) return 1;
+
+    result->x = column - 1;
+    result->y = row - 1;
+    return 0;
+}
+
+
+void row_name(char* buffer, unsigned int row) {
+    /* Writes name of row (counted from 0) to buffer - 'A' for 0, 'Z' for 25, 'AA' for 26 and so on */
+
+    char reversed[8];
+    int length = 0;
+    for (row++; row; row = (row - 1) / 26) reversed[length++] = 'A' + (row - 1) % 26;
+    for (int i = 0; i < length; ++i) buffer[i] = reversed[length - 1 - i];
+    buffer[length] = '\0';
+}
+
+
+void coord_name(char* buffer, int tile, unsigned int board_size) {
+    /* Writes name of tile (e.g. 'AB120') to buffer of at least 16 chars */
+
+    _COORD coord = tile_coord(tile, board_size);
+    row_name(buffer, coord.y);
+    sprintf(buffer + strlen(buffer), "%u", coord.x + 1);
+}
+
+
+SHOT fire(PLAYER* player_opponent, _COORD aim, unsigned int board_size) {
+    /* Fire of any board size (games use kernel of their size) */
+
+    return fire_kernel(player_opponent, aim, board_size);
+}
+
+
+static ALWAYS_INLINE SHOT fire_kernel(PLAYER* player_opponent, _COORD aim, unsigned int board_size) {
+    /* Checks whether given coordinates are valid (within board, repetitive strikes). If not, flag is INVALID.
+    If shot hits water, flag is VALID_MISS and VALID_HIT upon hitting ship. Hit ship is found in tile index
+    and its hit mask tells if it sinks (then also victory is checked). Function edits the board */
+
+    SHOT result = {INVALID, NO_SHIP, 0};
+    // checks if within board
+    if (aim.x >= board_size) return result;
+    if (aim.y >= board_size) return result;
+
+    BOARD* board = player_opponent->player_board;
+    int tile = tile_index(aim.x, aim.y, board_size);
+    // shoots where it is not allowed (repetitive strikes)
+    if (tile_shot(board, tile)) return result;
+    // actually fire
+    if (!player_opponent->ship_at[tile]) {
+        bit_set(board->misses, tile);  // hits water
+        result.flag = VALID_MISS;
+        return result;
+    }
+
+    bit_set(board->hits, tile);  // hits ship
+    result.flag = VALID_HIT;
+    int id = player_opponent->ship_at[tile] - 1;
+    FLEET_SHIP* ship = &player_opponent->ships[id];
+    int offset = tile - ship->origin;
+    if (ship->orientation == VERTICAL) offset /= board_size;
+    ship->hits |= 1 << offset;
+
+    if (ship->hits == (1 << ship->size) - 1) {    // last tile of the ship - ship sinks
+        for (int i = 0; i < ship->size; ++i) {
+            int ship_tile_index = ship_tile(ship, i, board_size);
+            bit_clear(board->hits, ship_tile_index);
+            bit_set(board->sunk, ship_tile_index);
+        }
+        player_opponent->ships_afloat--;
+        result.sunk = id;
+        result.victory = victory_check(player_opponent);
+    }
+    return result;
+}
+
+
+int victory_check(PLAYER* player_opponent) {
+    /* Returns 1 if opponent has no ship afloat (win), else 0 */
+
+    return player_opponent->ships_afloat == 0;
+}
+
+
+///////////////////////////////////////////////////
+//////////////////////// AI ///////////////////////
+///////////////////////////////////////////////////
+
+int computer_shot(GAME* game) {
+    /* Player on turn shoots where his AI chose - it is always tile which was not shot yet, so one
+    fire is enough. Nothing is printed, so it is used by game_step in console and headless simulation.
+    Returns 1 if enemy fleet was destroyed */
+
+    TIMER_START(start);
+    SHOT shot = game_fire(game, game_ai_move(game));
+    if (shot.flag == INVALID) COUNT(invalid_computer);
+    TIMER_STOP(computer_turns, start);
+    return shot.victory;
+}
+
+
+_COORD calculate_shot(PLAYER* player_opponent, unsigned int board_size, AI* ai) {
+    /* Tries to find enemy ship. While there are HITs of ships which are not sunk, AI shoots at the top of its
+    candidate stack - when two HITs are next to each other, it follows the line, otherwise it strikes around
+    them. AI always tries to sink hit ships. If there is no such HIT, random coordinates will be generated
+    (or most probable tile is chosen by AI_PROBABILITY). AI_MONTE_CARLO decides every shot by sampling */
+
+    BOARD* board = player_opponent->player_board;
+    if (ai->level == AI_MONTE_CARLO) return monte_carlo_shot(ai, player_opponent, board_size);
+    if (ai->open_count) {
+        int tile = next_candidate(ai, board, board_size);
+        if (tile != NO_SHOT) return tile_coord(tile, board_size);
+    }
+
+    if (ai->level == AI_PROBABILITY) return density_shot(ai, board_size);
+    else return random_shot(ai, board_size);
+}
+
+
+int next_candidate(AI* ai, BOARD* board, unsigned int board_size) {
+    /* Pops candidates until it finds tile which was not shot yet. Every candidate is pushed and popped once,
+    so this is O(1) amortized. When stack runs out, it is refilled around all open hits. Returns NO_SHOT
+    if there is nothing to shoot at around open hits */
+
+    for (int refilled = 0; refilled < 2; ++refilled) {
+        while (ai->candidate_count) {
+            int tile = ai->candidates[--ai->candidate_count];
+            if (!tile_shot(board, tile)) return tile;
+        }
+        COUNT(candidate_refills);
+        for (int i = 0; i < ai->open_count; ++i) push_neighbours(ai, board, ai->open_hits[i], board_size);
+    }
+    return NO_SHOT;
+}
+
+
+static ALWAYS_INLINE void push_neighbours(AI* ai, BOARD* board, int tile, unsigned int board_size) {
+    /* Called for each new HIT. Pushes unknown tiles around it to candidate stack. When HIT continues
+    line of HITs (e.g. XX~~ -> XXX~), next tile in the line and tile behind the other end are pushed
+    last, so they are shot first */
+
+    static const int dx[4] = {1, -1, 0, 0}, dy[4] = {0, 0, -1, 1};  // right, left, up, down
+    _COORD hit = tile_coord(tile, board_size);
+
+    for (int d = 0; d < 4; ++d) push_candidate(ai, board, hit.x + dx[d], hit.y + dy[d], board_size);
+
+    for (int d = 0; d < 4; ++d) {
+        int x = hit.x - dx[d], y = hit.y - dy[d];   // tile behind the HIT
+        if (x < 0 || x >= (int)board_size || y < 0 || y >= (int)board_size) continue;
+        if (!bit_get(board->hits, tile_index(x, y, board_size))) continue;  // no line in this direction
+
+        while (x >= 0 && x < (int)board_size && y >= 0 && y < (int)board_size && bit_get(board->hits, tile_index(x, y, board_size))) {
+            x -= dx[d];     // follows the line back to its other end
+            y -= dy[d];
+        }
+        push_candidate(ai, board, x, y, board_size);
+        push_candidate(ai, board, hit.x + dx[d], hit.y + dy[d], board_size);   // continues the line
+    }
+}
+
+
+static ALWAYS_INLINE void push_candidate(AI* ai, BOARD* board, int x, int y, unsigned int board_size) {
+    /* Pushes tile to candidate stack if it lies within board and was not shot yet */
+
+    if (x < 0 || x >= (int)board_size || y < 0 || y >= (int)board_size) return;
+    int tile = tile_index(x, y, board_size);
+    if (tile_shot(board, tile) || ai->candidate_count == MAX_SHOTS) return;
+    ai->candidates[ai->candidate_count++] = tile;
+}
+
+
+void remove_open_hits(AI* ai, BOARD* board) {
+    /* Removes tiles of sunk ship (they are SUNK now) from open hits. When no open hit is left,
+    candidates around them are useless and the stack is emptied */
+
+    for (int i = 0; i < ai->open_count; ++i) {
+        if (bit_get(board->sunk, ai->open_hits[i])) ai->open_hits[i--] = ai->open_hits[--ai->open_count];   // last one takes its place
+    }
+    if (ai->open_count == 0) ai->candidate_count = 0;
+}
+
+
+_COORD random_shot(AI* ai, unsigned int board_size) {
+    /* Returns random tile which was not shot yet. Tiles with odd x + y are preferred - every ship
+    covers at least one of them. Others are used only when all of them are gone */
+
+    int parity = ai->pool_count[1] ? 1 : 0;
+    COUNT(random_shots);
+    if (parity == 0) COUNT(parity_fallbacks);
+    return tile_coord(ai->pool[parity][random_below(&ai->rng, ai->pool_count[parity])], board_size);
+}
+
+
+static ALWAYS_INLINE void pool_remove(AI* ai, int tile, unsigned int board_size) {
+    /* Removes shot tile from its pool - last tile of the pool takes its place */
+
+    int parity = (tile % board_size + tile / board_size) & 1;
+    int slot = ai->pool_slot[tile];
+    int last = ai->pool[parity][--ai->pool_count[parity]];
+    ai->pool[parity][slot] = last;
+    ai->pool_slot[last] = slot;
+}
+
+
+///////////////////////////////////////////////////
+/////////////////// PROBABILITY AI ////////////////
+///////////////////////////////////////////////////
+
+
+void ai_reset(AI* ai, int level, const FLEET* fleet, unsigned int board_size) {
+    /* Prepares AI for new game against given fleet. For AI_PROBABILITY (and AI_MONTE_CARLO, which falls
+    back to it) counts all placements of each
+    ship size of the fleet over every tile of empty board. During the game these counts are only
+    decreased by ai_observe */
+
+    memset(ai, 0, sizeof(AI));
+    ai->level = level;
+    ai->budget = search_budget;
+    ai->sample_limit = search_samples;
+    ai->threads = 1;
+    for (int i = 0; i < (int)(board_size * board_size); ++i) {     // nothing is shot yet
+        int parity = (i % board_size + i / board_size) & 1;
+        ai->pool_slot[i] = ai->pool_count[parity];
+        ai->pool[parity][ai->pool_count[parity]++] = i;
+    }
+    if (level == AI_HUNT_TARGET) return;    // hunt/target AI needs only open hits and candidates
+
+    for (int id = 0; id < fleet->count; ++id) ai->afloat[SHIP_CLASSES[fleet->classes[id]].size]++;
+    board_kernels(board_size)->fill_density(ai);
+}
+
+
+static ALWAYS_INLINE void fill_density_kernel(AI* ai, unsigned int board_size) {
+    /* Counts all placements of each afloat ship size over every tile of empty board */
+
+    for (int size = 1; size <= MAX_SHIP; ++size) {
+        if (!ai->afloat[size]) continue;    // no ship of this size
+        for (int y = 0; y < (int)board_size; ++y) {
+            for (int x = 0; x < (int)board_size; ++x) {
+                int first = tile_index(x, y, board_size);
+                if (x + size <= (int)board_size) ai_add_window(ai, first, 1, size, 1);   // horizontal
+                if (y + size <= (int)board_size) ai_add_window(ai, first, board_size, size, 1);  // vertical
+            }
+        }
+    }
+}
+
+
+void ai_observe(AI* ai, PLAYER* player_opponent, _COORD aim, SHOT shot, unsigned int board_size) {
+    /* ai_observe of any board size (games use kernel of their size) */
+
+    observe_kernel(ai, player_opponent, aim, shot, board_size);
+}
+
+
+static ALWAYS_INLINE void observe_kernel(AI* ai, PLAYER* player_opponent, _COORD aim, SHOT shot, unsigned int board_size) {
+    /* Called after every shot. Shot tile leaves the pool. New HIT becomes open hit and tiles around it
+    candidates. When ship was sunk, its tiles are not open anymore. AI_PROBABILITY also blocks MISS
+    tile or tiles of sunk ship and removes contribution of sunk ship from density */
+
+    int tile = tile_index(aim.x, aim.y, board_size);
+    FLEET_SHIP* ship = NULL;
+    pool_remove(ai, tile, board_size);
+    if (shot.sunk != NO_SHIP) {
+        ship = &player_opponent->ships[shot.sunk];  // sunk ship is visible on board
+        remove_open_hits(ai, player_opponent->player_board);
+    }
+    else if (shot.flag == VALID_HIT) {
+        ai->open_hits[ai->open_count++] = tile;
+        push_neighbours(ai, player_opponent->player_board, tile, board_size);
+    }
+
+    if (ai->level == AI_HUNT_TARGET) return;
+
+    if (shot.flag == VALID_MISS) {
+        ai_block_tile(ai, tile, board_size);
+        return;
+    }
+    if (shot.sunk == NO_SHIP) return;    // HIT - nothing is known for sure yet
+
+    int ship_size = ship->size;
+    ai->afloat[ship_size]--;    // one ship less -> its placements do not count anymore
+    for (int i = 0; i < (int)(board_size * board_size); ++i) ai->density[i] -= ai->ship_density[ship_size][i];
+
+    for (int i = 0; i < ship_size; ++i) ai_block_tile(ai, ship_tile(ship, i, board_size), board_size);
+}
+
+
+static ALWAYS_INLINE void ai_block_tile(AI* ai, int tile, unsigned int board_size) {
+    /* Tile cannot contain afloat ship anymore. Every placement which covered the tile and was
+    legal until now is removed from density. Only placements around the tile are visited and
+    sizes without afloat ship are skipped - they do not count to density anymore */
+
+    int x = tile % board_size, y = tile / board_size;
+    for (int size = 1; size <= MAX_SHIP; ++size) {
+        if (!ai->afloat[size]) continue;
+        for (int i = 0; i < size; ++i) {
+            if (x - i >= 0 && x - i + size <= (int)board_size) {     // horizontal placement starting i tiles left
+                int first = tile - i;
+                if (ai_window_free(ai, first, 1, size)) ai_add_window(ai, first, 1, size, -1);
+            }
+            if (y - i >= 0 && y - i + size <= (int)board_size) {     // vertical placement starting i tiles up
+                int first = tile - i*board_size;
+                if (ai_window_free(ai, first, board_size, size)) ai_add_window(ai, first, board_size, size, -1);
+            }
+        }
+    }
+    bit_set(ai->blocked, tile);
+}
+
+
+static ALWAYS_INLINE int ai_window_free(AI* ai, int first, int step, int ship_size) {
+    /* Returns 1 if no tile of given placement is blocked, else 0 */
+
+    for (int i = 0; i < ship_size; ++i)
+        if (bit_get(ai->blocked, first + i*step)) return 0;
+    return 1;
+}
+
+
+static ALWAYS_INLINE void ai_add_window(AI* ai, int first, int step, int ship_size, int amount) {
+    /* Adds amount (1 or -1) to each tile of given placement - ship density of its size
+    and overall density weighted by number of afloat ships of that size */
+
+    for (int i = 0; i < ship_size; ++i) {
+        ai->ship_density[ship_size][first + i*step] += amount;
+        ai->density[first + i*step] += amount * ai->afloat[ship_size];
+    }
+}
+
+
+_COORD density_shot(AI* ai, unsigned int board_size) {
+    /* Returns tile, which was not shot yet, with the highest density (weighted by learned
+    table if there is one) */
+
+    if (!ai->prior) return tile_coord(best_pool_tile(ai, ai->density), board_size);
+
+    unsigned int weight[MAX_SHOTS];
+    memcpy(weight, ai->density, sizeof(unsigned int) * board_size * board_size);
+    learned_weights(ai, weight, board_size);
+    return tile_coord(best_pool_tile(ai, weight), board_size);
+}
+
+
+int best_pool_tile(AI* ai, const unsigned int weight[]) {
+    /* Returns tile of the pool (not shot yet) with the highest weight. Only tiles of the pool
+    are visited. When more tiles have the same weight, random one of them is chosen */
+
+    unsigned int best = 0;
+    int best_tile = -1, ties = 0;
+
+    for (int j = 0; j < ai->pool_count[0] + ai->pool_count[1]; ++j) {
+        int i = j < ai->pool_count[0] ? ai->pool[0][j] : ai->pool[1][j - ai->pool_count[0]];
+        if (best_tile >= 0 && weight[i] < best) continue;
+
+        if (best_tile < 0 || weight[i] > best) {
+            best = weight[i];
+            best_tile = i;
+            ties = 1;
+        }
+        else if (random_below(&ai->rng, ++ties) == 0) best_tile = i;    // each of tied tiles has equal chance
+    }
+    return best_tile;
+}
+
+
+///////////////////////////////////////////////////
+//////////////// SPECIALIZED KERNELS //////////////
+///////////////////////////////////////////////////
+
+
+/* Every supported board size gets its own copy of hot paths of the game - kernel bodies are forced inline and
+called with board size as a constant, so divisions by board size, loop bounds and neighbour offsets are
+compiled as constants. Game chooses its kernels once in game_start */
+
+#define KERNEL_SIZES(X) X(5) X(6) X(7) X(8) X(9) X(10) X(11) X(12) X(13) X(14) X(15) X(16) X(17) X(18) X(19) X(20) \
+    X(21) X(22) X(23) X(24) X(25) X(26)
+_Static_assert(MAX_BOARD == 26, "KERNEL_SIZES has to list every board size from 5 to MAX_BOARD");
+
+#define DEFINE_KERNELS(n) \
+    static SHOT fire_##n(PLAYER* player_opponent, _COORD aim) { return fire_kernel(player_opponent, aim, n); } \
+    static void observe_##n(AI* ai, PLAYER* player_opponent, _COORD aim, SHOT shot) { observe_kernel(ai, player_opponent, aim, shot, n); } \
+    static void fill_density_##n(AI* ai) { fill_density_kernel(ai, n); }
+#define KERNEL_ENTRY(n) [n] = {fire_##n, observe_##n, fill_density_##n},
+
+KERNEL_SIZES(DEFINE_KERNELS)
+
+static const KERNELS KERNEL_TABLE[MAX_BOARD + 1] = {KERNEL_SIZES(KERNEL_ENTRY)};
+
+
+const KERNELS* board_kernels(unsigned int board_size) {
+    /* Returns kernels compiled for given board size (5 to MAX_BOARD), NULL for other sizes */
+
+    if (board_size < 5 || board_size > MAX_BOARD) return NULL;
+    return &KERNEL_TABLE[board_size];
+}
+
+
+///////////////////////////////////////////////////
+/////////////////// MONTE CARLO AI ////////////////
+///////////////////////////////////////////////////
+
+
+_COORD monte_carlo_shot(AI* ai, PLAYER* player_opponent, unsigned int board_size) {
+    /* Samples whole fleets of afloat ships which agree with every MISS, HIT and SUNK tile until the budget
+    runs out, on ai->threads threads (helpers of search pool and the caller). The tile covered by most samples
+    is shot - it is the most likely place of a ship. Each thread counts into its own sampler, counts are added
+    up at the end. When nothing was sampled in time, AI_PROBABILITY decides */
+
+    BOARD* board = player_opponent->player_board;
+    SEARCH job;
+    memcpy(job.blocked, ai->blocked, sizeof(job.blocked));
+    memcpy(job.hits, board->hits, sizeof(job.hits));
+    for (int size = 0; size <= MAX_SHIP; ++size) job.afloat[size] = ai->afloat[size];
+    job.board_size = board_size;
+    job.limit = ai->sample_limit;
+    atomic_init(&job.total, 0);
+    job.placements = placement_table(board_size);
+
+    int threads = ai->threads < 1 ? 1 : ai->threads > MAX_THREADS ? MAX_THREADS : ai->threads;
+    int helpers = 0;
+    SAMPLER local;
+    SAMPLER* samplers = &local;
+#ifdef HAS_THREADS
+    SEARCH_POOL* pool = NULL;
+    if (threads > 1) {
+        pool = search_pool_get(threads - 1);
+        helpers = threads - 1 < pool->helpers ? threads - 1 : pool->helpers;
+        samplers = pool->samplers;
+    }
+#endif
+    for (int i = 0; i <= helpers; ++i) {
+        seed_random(&samplers[i].rng, next_random(&ai->rng), i);
+        memset(samplers[i].counts, 0, sizeof(samplers[i].counts));
+        samplers[i].samples = 0;
+    }
+    double start = wall_time();
+    job.deadline = start + ai->budget * (ai->speculative ? SPECULATION_STRETCH : 1);
+    job.soon = start + ai->budget;
+    job.hurry = ai->speculative ? &ai->hurry : NULL;
+
+#ifdef HAS_THREADS
+    if (helpers) {
+        mtx_lock(&pool->lock);
+        pool->job = &job;
+        pool->active = helpers;
+        pool->running = helpers;
+        pool->generation++;
+        cnd_broadcast(&pool->start);
+        mtx_unlock(&pool->lock);
+    }
+#endif
+    monte_carlo_run(&job, &samplers[0]);
+#ifdef HAS_THREADS
+    if (helpers) {
+        mtx_lock(&pool->lock);
+        while (pool->running) cnd_wait(&pool->done, &pool->lock);
+        mtx_unlock(&pool->lock);
+    }
+#endif
+
+    unsigned int counts[MAX_SHOTS];
+    memcpy(counts, samplers[0].counts, sizeof(counts));
+    for (int i = 1; i <= helpers; ++i) {
+        for (int tile = 0; tile < (int)(board_size * board_size); ++tile) counts[tile] += samplers[i].counts[tile];
+    }
+
+    if (ai->prior) learned_weights(ai, counts, board_size);
+    int tile = best_pool_tile(ai, counts);
+    if (counts[tile] == 0) {    // no sample
+        COUNT(mc_fallbacks);
+        return density_shot(ai, board_size);
+    }
+    return tile_coord(tile, board_size);
+}
+
+
+void monte_carlo_run(SEARCH* job, SAMPLER* sampler) {
+    /* Samples until deadline or until all threads together have enough samples. Speculative search also
+    ends when it is hurried and its normal budget is over. Time is checked after every MC_BATCH samples */
+
+    while (1) {
+        unsigned long found = 0;
+        for (int i = 0; i < MC_BATCH; ++i) found += monte_carlo_sample(job, sampler);
+        sampler->samples += found;
+        unsigned long total = atomic_fetch_add(&job->total, found) + found;
+        if (job->limit && total >= job->limit) return;
+
+        double now = wall_time();
+        if (now >= job->deadline) return;
+        if (job->hurry && atomic_load(job->hurry) && now >= job->soon) return;
+    }
+}
+
+
+int monte_carlo_sample(SEARCH* job, SAMPLER* sampler) {
+    /* Places all afloat ships so that they cover every HIT and avoid every MISS and SUNK tile. HITs are
+    covered first - each uncovered HIT gets random placement (of random afloat ship) over it - then the
+    rest of ships is placed to free placements of table. Tiles of placed ships are counted in sampler.
+    Returns 0 if the sample got stuck (it is thrown away), else 1 */
+
+    unsigned int board_size = job->board_size;
+    BOARD taken;    // only ships plane is used - blocked tiles and placed ships
+    uint64_t uncovered[BOARD_WORDS], fleet[BOARD_WORDS] = {0};
+    int left[MAX_SHIP + 1];
+
+    memcpy(taken.ships, job->blocked, sizeof(taken.ships));
+    memcpy(uncovered, job->hits, sizeof(uncovered));
+    memcpy(left, job->afloat, sizeof(left));
+
+    for (int word = 0; word < BOARD_WORDS; ++word) {
+        while (uncovered[word]) {
+            int hit = word * 64 + lowest_bit(uncovered[word]);
+            int hit_x = hit % board_size, hit_y = hit / board_size;
+            int first[2 * MAX_SHIP * MAX_SHIP], step[2 * MAX_SHIP * MAX_SHIP], size[2 * MAX_SHIP * MAX_SHIP];
+            int options = 0, total = 0;
+
+            for (int ship_size = 1; ship_size <= MAX_SHIP; ++ship_size) {   // every placement of afloat ship over HIT
+                if (!left[ship_size]) continue;
+                for (int offset = 0; offset < ship_size; ++offset) {
+                    for (int orientation = VERTICAL; orientation <= HORIZONTAL; ++orientation) {
+                        int x = hit_x, y = hit_y;
+                        if (orientation == HORIZONTAL) x -= offset;
+                        else y -= offset;
+                        if (x < 0 || y < 0) continue;
+                        if ((orientation == HORIZONTAL ? x : y) + ship_size > (int)board_size) continue;
+
+                        int tile = tile_index(x, y, board_size), tile_step = orientation == HORIZONTAL ? 1 : board_size;
+                        int i = 0;
+                        while (i < ship_size && !bit_get(taken.ships, tile + i*tile_step)) i++;
+                        if (i < ship_size) continue;    // crosses MISS, SUNK or placed ship
+
+                        first[options] = tile;
+                        step[options] = tile_step;
+                        size[options++] = ship_size;
+                        total += left[ship_size];   // more ships of the same size -> more ways
+                    }
+                }
+            }
+            if (total == 0) {
+                COUNT(mc_rejects);
+                return 0;
+            }
+
+            int chosen = 0;
+            for (int r = random_below(&sampler->rng, total); r >= left[size[chosen]]; chosen++) r -= left[size[chosen]];
+            for (int i = 0; i < size[chosen]; ++i) {
+                int tile = first[chosen] + i*step[chosen];
+                bit_set(taken.ships, tile);
+                bit_set(fleet, tile);
+                bit_clear(uncovered, tile);
+            }
+            left[size[chosen]]--;
+        }
+    }
+
+    for (int ship_size = MAX_SHIP; ship_size >= 1; --ship_size) {     // longest ships first - they fit worst
+        for (int i = 0; i < left[ship_size]; ++i) {
+            int index = random_placement(job->placements, &taken, &sampler->rng, ship_size, 1);
+            if (index < 0) {
+                COUNT(mc_rejects);
+                return 0;
+            }
+            placement_add(taken.ships, &job->placements->placements[ship_size][index]);
+            placement_add(fleet, &job->placements->placements[ship_size][index]);
+        }
+    }
+
+    for (int word = 0; word < BOARD_WORDS; ++word) {
+        for (uint64_t bits = fleet[word] & ~job->hits[word]; bits; bits &= bits - 1) sampler->counts[word * 64 + lowest_bit(bits)]++;
+    }
+    COUNT(mc_samples);
+    return 1;
+}
+
+
+static inline void placement_add(uint64_t plane[], const PLACEMENT* placement) {
+    /* Sets tiles of placement in bit-plane */
+
+    for (int i = 0; i < PLACEMENT_WORDS; ++i) plane[placement->word + i] |= placement->mask[i];
+}
+
+
+#ifdef HAS_THREADS
+SEARCH_POOL* search_pool_get(int helpers) {
+    /* Returns search pool, which is started by the first search with more threads. Its helpers sleep
+    between searches and live until the program ends. Later searches use at most this many helpers.
+    Only one search may use the pool at a time */
+
+    if (search_pool) return search_pool;
+    if (helpers > MAX_THREADS - 1) helpers = MAX_THREADS - 1;
+
+    SEARCH_POOL* pool = (SEARCH_POOL*) ALIGNED_ALLOC(sizeof(SEARCH_POOL));
+    mtx_init(&pool->lock, mtx_plain);
+    cnd_init(&pool->start);
+    cnd_init(&pool->done);
+    pool->helpers = 0;
+    pool->active = 0;
+    pool->running = 0;
+    pool->generation = 0;
+    search_pool = pool;
+
+    for (int i = 1; i <= helpers; ++i) {
+        thrd_t thread;
+        if (thrd_create(&thread, search_helper, (void*)(intptr_t)i) != thrd_success) break;
+        thrd_detach(thread);
+        pool->helpers++;
+    }
+    return pool;
+}
+
+
+int search_helper(void* arg) {
+    /* Body of helper thread of search pool. Waits for new search and samples with its own sampler */
+
+    int id = (int)(intptr_t)arg;
+    SEARCH_POOL* pool = search_pool;
+    unsigned long seen = 0;
+
+    while (1) {
+        mtx_lock(&pool->lock);
+        while (pool->generation == seen) cnd_wait(&pool->start, &pool->lock);
+        seen = pool->generation;
+        int used = id <= pool->active;
+        SEARCH* job = pool->job;
+        mtx_unlock(&pool->lock);
+        if (!used) continue;
+
+        monte_carlo_run(job, &pool->samplers[id]);
+        mtx_lock(&pool->lock);
+        if (--pool->running == 0) cnd_signal(&pool->done);
+        mtx_unlock(&pool->lock);
+    }
+    return 0;
+}
+#endif
+
+
+///////////////////////////////////////////////////
+///////////////////// BITBOARD ////////////////////
+///////////////////////////////////////////////////
+
+
+static inline int tile_index(unsigned short x, unsigned short y, unsigned int board_size) {
+    /* Converts coordinates to index of bit in bit-planes (board is stored row by row) */
+
+    return y * board_size + x;
+}
+
+
+static inline _COORD tile_coord(int tile, unsigned int board_size) {
+    /* Converts index of bit back to coordinates */
+
+    _COORD result = {tile % board_size, tile / board_size};
+    return result;
+}
+
+
+static inline int tile_shot(BOARD* board, int tile) {
+    /* Returns 1 if somebody already shot at the tile (HIT, MISS or SUNK), else 0 */
+
+    return bit_get(board->hits, tile) | bit_get(board->misses, tile) | bit_get(board->sunk, tile);
+}
+
+
+static inline int bit_get(const uint64_t plane[], int tile) {
+    /* Returns 1 if tile is set in given bit-plane, else 0 */
+
+    return (plane[tile >> 6] >> (tile & 63)) & 1;
+}
+
+
+static inline void bit_set(uint64_t plane[], int tile) {
+    /* Sets tile in given bit-plane */
+
+    plane[tile >> 6] |= (uint64_t)1 << (tile & 63);
+}
+
+
+static inline void bit_clear(uint64_t plane[], int tile) {
+    /* Clears tile in given bit-plane */
+
+    plane[tile >> 6] &= ~((uint64_t)1 << (tile & 63));
+}
+
+
+static inline int lowest_bit(uint64_t word) {
+    /* Returns position of lowest set bit of non-zero word */
+
+#ifdef __GNUC__
+    return __builtin_ctzll(word);   // single instruction on most CPUs
+#else
+    int result = 0;
+    while (!(word & 1)) {
+        word >>= 1;
+        result++;
+    }
+    return result;
+#endif
+}
+
+
+static inline int bit_count(uint64_t word) {
+    /* Returns number of set bits in word */
+
+#ifdef __GNUC__
+    return __builtin_popcountll(word);
+#else
+    int result = 0;
+    for (; word; word &= word - 1) result++;    // clears lowest set bit
+    return result;
+#endif
+}
+
+
+static inline int ship_tile(FLEET_SHIP* ship, int i, unsigned int board_size) {
+    /* Returns tile of i-th part of ship (counted from origin) */
+
+    return ship->origin + (ship->orientation == HORIZONTAL ? i : i * (int)board_size);
+}
+
+
+char tile_state(BOARD* board, int tile) {
+    /* Combines bit-planes of one tile into sign which is shown on board */
+
+    if (bit_get(board->sunk, tile)) return SUNK;
+    if (bit_get(board->hits, tile)) return HIT;
+    if (bit_get(board->misses, tile)) return MISS;
+    if (bit_get(board->ships, tile)) return PLACED_SHIP;
+    return DEFAULT;
+}
+
+
+///////////////////////////////////////////////////
+///////////////////// LARGE BOARD /////////////////
+///////////////////////////////////////////////////
+
+
+LARGE_SESSION* create_large_session(const FLEET* fleet) {
+    /* Allocates session for boards bigger than MAX_BOARD. Its size does not depend on board size - shots
+    are kept in sparse planes which grow with number of shots. Like small session, it is reset in place */
+
+    LARGE_SESSION* session = (LARGE_SESSION*) calloc(1, sizeof(LARGE_SESSION));
+    session->fleet = *fleet;
+    reset_large_session(session);
+    return session;
+}
+
+
+void reset_large_session(LARGE_SESSION* session) {
+    /* Clears shots of both players and gives them fleet of session. Allocated pages are kept for next game */
+
+    for (int i = 0; i < 2; ++i) {
+        LARGE_PLAYER* player = &session->players[i];
+        player->last_shot = NO_SHOT;
+        player->shots_taken = 0;
+        player->hits_taken = 0;
+        player->fleet_size = session->fleet.count;
+        player->ships_afloat = session->fleet.count;
+        for (int id = 0; id < session->fleet.count; ++id) {
+            player->ships[id].ship_class = session->fleet.classes[id];
+            player->ships[id].size = SHIP_CLASSES[session->fleet.classes[id]].size;
+            player->ships[id].hits = 0;
+        }
+        memset(player->index_tiles, 0, sizeof(player->index_tiles));
+        sparse_clear(&player->shots);
+    }
+}
+
+
+void free_large_session(LARGE_SESSION* session) {
+    /* Frees pages of both players and session itself */
+
+    sparse_free(&session->players[0].shots);
+    sparse_free(&session->players[1].shots);
+    free(session);
+}
+
+
+static inline int sparse_get(const SPARSE* plane, unsigned int x, unsigned int y) {
+    /* Returns 1 if tile is set in sparse plane, else 0. Tiles of missing page are not set */
+
+    const uint64_t* page = plane->pages[(y / PAGE_SIDE) * (MAX_LARGE_BOARD / PAGE_SIDE) + x / PAGE_SIDE];
+    if (!page) return 0;
+    return (page[y % PAGE_SIDE] >> (x % PAGE_SIDE)) & 1;
+}
+
+
+void sparse_set(SPARSE* plane, unsigned int x, unsigned int y) {
+    /* Sets tile in sparse plane, page of the tile is allocated if it is the first one */
+
+    uint64_t** page = &plane->pages[(y / PAGE_SIDE) * (MAX_LARGE_BOARD / PAGE_SIDE) + x / PAGE_SIDE];
+    if (!*page) {
+        *page = (uint64_t*) calloc(PAGE_SIDE, sizeof(uint64_t));
+        plane->page_count++;
+    }
+    (*page)[y % PAGE_SIDE] |= (uint64_t)1 << (x % PAGE_SIDE);
+}
+
+
+void sparse_clear(SPARSE* plane) {
+    /* Clears all tiles, but keeps allocated pages */
+
+    if (!plane->page_count) return;
+    for (int i = 0; i < MAX_PAGES; ++i) {
+        if (plane->pages[i]) memset(plane->pages[i], 0, PAGE_SIDE * sizeof(uint64_t));
+    }
+}
+
+
+void sparse_free(SPARSE* plane) {
+    /* Frees all pages of sparse plane */
+
+    for (int i = 0; i < MAX_PAGES; ++i) free(plane->pages[i]);
+    memset(plane, 0, sizeof(SPARSE));
+}
+
+
+static inline unsigned int index_slot(int tile) {
+    /* Returns first slot of tile in ship index (Fibonacci hashing - top bits of product) */
+
+    return (uint32_t)((uint32_t)tile * 2654435761u) >> (32 - FLEET_INDEX_BITS);
+}
+
+
+int large_ship_at(LARGE_PLAYER* player, int tile) {
+    /* Returns id of ship lying on tile or NO_SHIP. Slots are probed one after another until empty one */
+
+    for (unsigned int slot = index_slot(tile); player->index_tiles[slot]; slot = (slot + 1) & (FLEET_INDEX - 1)) {
+        if (player->index_tiles[slot] == (unsigned int)tile + 1) return player->index_ids[slot];
+    }
+    return NO_SHIP;
+}
+
+
+void large_placement(LARGE_PLAYER* result, RNG* rng, unsigned int board_size) {
+    /* Places fleet of large board randomly. When some ship could not be placed (only with big fleets
+    on the smallest large boards), whole fleet is placed again */
+
+    while (large_random_fleet(result, rng, board_size)) COUNT(fleet_restarts);
+}
+
+
+int large_random_fleet(LARGE_PLAYER* result, RNG* rng, unsigned int board_size) {
+    /* Ships take tiny part of large board, so random position of ship is almost always free - there are
+    no placement tables. Every ship tile is added to ship index. Returns 1 if some ship did not fit
+    in RANDOM_TRIES draws, else 0 */
+
+    memset(result->index_tiles, 0, sizeof(result->index_tiles));
+    result->ships_afloat = result->fleet_size;
+
+    for (int id = 0; id < result->fleet_size; ++id) {
+        FLEET_SHIP* ship = &result->ships[id];
+        int tries = 0;
+        for (; tries < RANDOM_TRIES; ++tries) {
+            unsigned int along = random_below(rng, board_size - ship->size + 1);
+            unsigned int across = random_below(rng, board_size);
+            ship->orientation = random_below(rng, 2) ? HORIZONTAL : VERTICAL;
+            ship->origin = ship->orientation == HORIZONTAL ? tile_index(along, across, board_size) : tile_index(across, along, board_size);
+
+            int i = 0;
+            while (i < ship->size && large_ship_at(result, ship_tile(ship, i, board_size)) == NO_SHIP) i++;
+            if (i == ship->size) break;     // all tiles are free
+            COUNT(placement_misses);
+        }
+        if (tries == RANDOM_TRIES) return 1;
+
+        ship->hits = 0;
+        for (int i = 0; i < ship->size; ++i) {
+            int tile = ship_tile(ship, i, board_size);
+            unsigned int slot = index_slot(tile);
+            while (result->index_tiles[slot]) slot = (slot + 1) & (FLEET_INDEX - 1);
+            result->index_tiles[slot] = tile + 1;
+            result->index_ids[slot] = id;
+        }
+    }
+    return 0;
+}
+
+
+SHOT large_fire(LARGE_PLAYER* player_opponent, _COORD aim, unsigned int board_size) {
+    /* Same as fire, only shot tiles are stored in sparse plane and ship is found in ship index */
+
+    SHOT result = {INVALID, NO_SHIP, 0};
+    if (aim.x >= board_size || aim.y >= board_size) return result;
+    if (sparse_get(&player_opponent->shots, aim.x, aim.y)) return result;     // repetitive strike
+
+    sparse_set(&player_opponent->shots, aim.x, aim.y);
+    player_opponent->shots_taken++;
+    int tile = tile_index(aim.x, aim.y, board_size);
+    int id = large_ship_at(player_opponent, tile);
+    if (id == NO_SHIP) {
+        result.flag = VALID_MISS;
+        return result;
+    }
+
+    result.flag = VALID_HIT;
+    player_opponent->hits_taken++;
+    FLEET_SHIP* ship = &player_opponent->ships[id];
+    int offset = tile - ship->origin;
+    if (ship->orientation == VERTICAL) offset /= board_size;
+    ship->hits |= 1 << offset;
+
+    if (ship->hits == (1 << ship->size) - 1) {    // last tile of the ship - ship sinks
+        player_opponent->ships_afloat--;
+        result.sunk = id;
+        result.victory = player_opponent->ships_afloat == 0;
+    }
+    return result;
+}
+
+
+char large_tile_state(LARGE_PLAYER* player, unsigned int x, unsigned int y, unsigned int board_size) {
+    /* Returns sign of tile of large board */
+
+    int id = large_ship_at(player, tile_index(x, y, board_size));
+    int shot = sparse_get(&player->shots, x, y);
+    if (id == NO_SHIP) return shot ? MISS : DEFAULT;
+    if (player->ships[id].hits == (1 << player->ships[id].size) - 1) return SUNK;
+    return shot ? HIT : PLACED_SHIP;
+}
+
+
+void large_ai_reset(LARGE_AI* ai, unsigned int board_size) {
+    /* Prepares hunt/target AI of large board for new game. Generator is seeded by caller */
+
+    ai->open_count = 0;
+    ai->candidate_count = 0;
+    ai->odd_left = (board_size * board_size) / 2;  // odd x + y - on odd boards the even tiles have one more (5x5: 12 + 13)
+}
+
+
+void large_vs_computer(unsigned int board_size) {
+    /* PvCPU mode on board bigger than MAX_BOARD against hunt/target AI. Both fleets are placed randomly
+    (finding free tiles on huge board by typing is no fun). Session is allocated only for this game */
+
+    LARGE_SESSION* session = create_large_session(&CLASSIC_FLEET);
+    LARGE_PLAYER* player1 = &session->players[0];
+    LARGE_PLAYER* player2 = &session->players[1];
+
+    printf("\n\tEnter your nick: ");
+    fgets(player1->nick, MAX_NAME, stdin);
+    char* new_line = strchr(player1->nick, '\n'); // removes '\n'
+    if(new_line) *new_line = '\0';
+    strcpy(player2->nick, "COMPUTER");
+
+    seed_random(&session->rng, time(NULL), 0);
+    seed_random(&session->ai[1].rng, time(NULL), 1);
+    large_ai_reset(&session->ai[1], board_size);
+    large_placement(player1, &session->rng, board_size);
+    large_placement(player2, &session->rng, board_size);
+
+    while (1) {
+        // first player
+        if (large_player_turn(player1, player2, board_size)) break;
+
+        // second player
+        if (large_computer_shot(player2, player1, &session->ai[1], board_size)) {
+            large_screen(player1, player2, board_size);
+            printf(BRIGHT_RED_COLOR"\n\t###################################\n");
+            printf("\t###################################\n");
+            printf("\t     ------- YOU LOST! -------\n");
+            printf("\t###################################\n");
+            printf("\t###################################\n");
+            break;
+        }
+    }
+    free_large_session(session);
+
+    printf(DEFAULT_COLOR"\n\tCongratulations! You just won ");
+    printf(UNDERLINE_COLOR"3 points.\n"DEFAULT_COLOR);
+}
+
+
+int large_player_turn(LARGE_PLAYER* player_active, LARGE_PLAYER* player_opponent, unsigned int board_size) {
+    /* Same as player_turn on large board. Returns 1 if opponent's fleet was destroyed */
+
+    large_screen(player_active, player_opponent, board_size);
+    TIMER_START(start);
+    _COORD aim = get_coord();
+    SHOT shot = large_fire(player_opponent, aim, board_size);
+    while(shot.flag == INVALID) {    // repeats until valid coordinates are given
+        COUNT(invalid_player);
+        printf(UNDERLINE_COLOR"\n\tInvalid shot Captain!");
+        aim = get_coord();
+        shot = large_fire(player_opponent, aim, board_size);
+    }
+    player_active->last_shot = tile_index(aim.x, aim.y, board_size);
+    TIMER_STOP(player_turns, start);
+
+    if (shot.victory) {  // victory screen
+        large_screen(player_active, player_opponent, board_size);
+        printf(BRIGHT_RED_COLOR"\n\t##################################\n");
+        printf("\t##################################\n");
+        printf("\t  ------- VICTORY %s -------\n", player_active->nick);
+        printf("\t##################################\n");
+        printf("\t##################################\n");
+        return 1;
+    }
+    return 0;
+}
+
+
+void large_screen(LARGE_PLAYER* player_active, LARGE_PLAYER* player_opponent, unsigned int board_size) {
+    /* Large board does not fit to terminal. Screen shows STATUS, summary of both fleets and two viewports
+    of VIEWPORT x VIEWPORT tiles - own fleet around enemy's last shot and enemy board around own last shot */
+
+    TIMER_START(start);
+    FRAME* frame = &screen;
+    char own_name[16] = "-", enemy_name[16] = "-";
+    char own_shot = 0, enemy_shot = 0;
+    _COORD own = {0, 0}, enemy = {0, 0};
+
+    if (player_active->last_shot != NO_SHOT) {
+        own = tile_coord(player_active->last_shot, board_size);
+        own_shot = large_tile_state(player_opponent, own.x, own.y, board_size);
+        coord_name(own_name, player_active->last_shot, board_size);
+    }
+    if (player_opponent->last_shot != NO_SHOT) {
+        enemy = tile_coord(player_opponent->last_shot, board_size);
+        enemy_shot = large_tile_state(player_active, enemy.x, enemy.y, board_size);
+        coord_name(enemy_name, player_opponent->last_shot, board_size);
+    }
+
+    frame_text(frame, "\033c"DEFAULT_COLOR);  // clears the screen
+    frame->color = DEFAULT_COLOR;
+    frame_color(frame, BLUE_COLOR);
+    frame_printf(frame, "\n\t%s's", player_active->nick);
+    frame_color(frame, DEFAULT_COLOR);
+    frame_printf(frame, " turn (board %ux%u)\n", board_size, board_size);
+    print_dialogue(frame, player_active->nick, own_shot, enemy_shot);
+
+    // summary
+    frame_color(frame, DEFAULT_COLOR);
+    frame_printf(frame, "\n\tYour fleet: %d/%d afloat, enemy fired %lu shots, %lu hits (last %s)",
+                 player_active->ships_afloat, player_active->fleet_size, player_active->shots_taken, player_active->hits_taken, enemy_name);
+    frame_printf(frame, "\n\t%s's fleet: %d/%d afloat, you fired %lu shots, %lu hits (last %s)\n",
+                 player_opponent->nick, player_opponent->ships_afloat, player_opponent->fleet_size,
+                 player_opponent->shots_taken, player_opponent->hits_taken, own_name);
+
+    // viewports
+    unsigned int left_x = viewport_start(enemy.x, board_size), left_y = viewport_start(enemy.y, board_size);
+    unsigned int right_x = viewport_start(own.x, board_size), right_y = viewport_start(own.y, board_size);
+    frame_printf(frame, "\n\t%-*s\t\tHits and Misses:\n", 4 + VIEWPORT * 5, "Your fleet:");
+    frame_text(frame, "\n\t    ");
+    for (int i = 0; i < VIEWPORT; ++i) frame_printf(frame, "%4u ", left_x + i + 1);
+    frame_text(frame, "\t\t    ");
+    for (int i = 0; i < VIEWPORT; ++i) frame_printf(frame, "%4u ", right_x + i + 1);
+    frame_text(frame, "\n");
+
+    for (int i = 0; i < VIEWPORT; ++i) {
+        frame_text(frame, "\n\t");
+        large_viewport_row(frame, player_active, left_x, left_y + i, 0, board_size);
+        frame_text(frame, "\t\t");
+        large_viewport_row(frame, player_opponent, right_x, right_y + i, 1, board_size);
+    }
+    frame_color(frame, DEFAULT_COLOR);
+    frame_text(frame, "\n");
+    print_hint(frame);
+    frame_present(frame);
+    TIMER_STOP(renders, start);
+}
+
+
+void large_viewport_row(FRAME* frame, LARGE_PLAYER* player, unsigned int x0, unsigned int y, int hide_ships, unsigned int board_size) {
+    /* Prints one row of viewport - row name and VIEWPORT tiles starting at column x0 */
+
+    char name[8];
+    row_name(name, y);
+    frame_color(frame, DEFAULT_COLOR);
+    frame_printf(frame, "%-4s", name);
+    for (int i = 0; i < VIEWPORT; ++i) {
+        char tile = large_tile_state(player, x0 + i, y, board_size);
+        if (hide_ships && tile == PLACED_SHIP) tile = DEFAULT;    // cannot tell, if enemy ship's there
+
+        frame_color(frame, tile_color(tile));
+        frame_text(frame, "   ");
+        frame_char(frame, tile);
+        frame_char(frame, ' ');
+    }
+}
+
+
+static inline unsigned int viewport_start(int center, unsigned int board_size) {
+    /* Returns first row (or column) of viewport, so that center is in the middle of it if possible */
+
+    if (center < VIEWPORT / 2) return 0;
+    if (center - VIEWPORT / 2 > (int)board_size - VIEWPORT) return board_size - VIEWPORT;
+    return center - VIEWPORT / 2;
+}
+
+
+int large_computer_shot(LARGE_PLAYER* player_active, LARGE_PLAYER* player_opponent, LARGE_AI* ai, unsigned int board_size) {
+    /* Same as computer_shot on large board. Returns 1 if enemy fleet was destroyed */
+
+    TIMER_START(start);
+    _COORD aim = large_calculate_shot(ai, player_opponent, board_size);
+    SHOT shot = large_fire(player_opponent, aim, board_size);
+    if (shot.flag == INVALID) COUNT(invalid_computer);
+    player_active->last_shot = tile_index(aim.x, aim.y, board_size);
+
+    large_ai_observe(ai, player_opponent, aim, shot, board_size);
+    TIMER_STOP(computer_turns, start);
+    return shot.victory;
+}
+
+
+_COORD large_calculate_shot(LARGE_AI* ai, LARGE_PLAYER* player_opponent, unsigned int board_size) {
+    /* Hunt/target AI of large board - same as calculate_shot with AI_HUNT_TARGET. Candidates around open
+    hits go first, otherwise random tile is shot */
+
+    for (int refilled = 0; ai->open_count && refilled < 2; ++refilled) {
+        while (ai->candidate_count) {
+            _COORD aim = tile_coord(ai->candidates[--ai->candidate_count], board_size);
+            if (!sparse_get(&player_opponent->shots, aim.x, aim.y)) return aim;
+        }
+        COUNT(candidate_refills);
+        for (int i = 0; i < ai->open_count; ++i) large_push_neighbours(ai, player_opponent, ai->open_hits[i], board_size);
+    }
+    return large_random_shot(ai, player_opponent, board_size);
+}
+
+
+void large_push_neighbours(LARGE_AI* ai, LARGE_PLAYER* player_opponent, int tile, unsigned int board_size) {
+    /* Same as push_neighbours - tiles around HIT are pushed, line of HITs is followed to both ends */
+
+    static const int dx[4] = {1, -1, 0, 0}, dy[4] = {0, 0, -1, 1};  // right, left, up, down
+    _COORD hit = tile_coord(tile, board_size);
+
+    for (int d = 0; d < 4; ++d) large_push_candidate(ai, player_opponent, hit.x + dx[d], hit.y + dy[d], board_size);
+
+    for (int d = 0; d < 4; ++d) {
+        int x = hit.x - dx[d], y = hit.y - dy[d];   // tile behind the HIT
+        if (x < 0 || x >= (int)board_size || y < 0 || y >= (int)board_size) continue;
+        if (large_tile_state(player_opponent, x, y, board_size) != HIT) continue;  // no line in this direction
+
+        while (x >= 0 && x < (int)board_size && y >= 0 && y < (int)board_size && large_tile_state(player_opponent, x, y, board_size) == HIT) {
+            x -= dx[d];     // follows the line back to its other end
+            y -= dy[d];
+        }
+        large_push_candidate(ai, player_opponent, x, y, board_size);
+        large_push_candidate(ai, player_opponent, hit.x + dx[d], hit.y + dy[d], board_size);   // continues the line
+    }
+}
+
+
+void large_push_candidate(LARGE_AI* ai, LARGE_PLAYER* player_opponent, int x, int y, unsigned int board_size) {
+    /* Pushes tile to candidate stack if it lies within board and was not shot yet */
+
+    if (x < 0 || x >= (int)board_size || y < 0 || y >= (int)board_size) return;
+    if (sparse_get(&player_opponent->shots, x, y) || ai->candidate_count == LARGE_CANDIDATES) return;
+    ai->candidates[ai->candidate_count++] = tile_index(x, y, board_size);
+}
+
+
+_COORD large_random_shot(LARGE_AI* ai, LARGE_PLAYER* player_opponent, unsigned int board_size) {
+    /* Returns random tile which was not shot yet, tiles with odd x + y are preferred while there are some.
+    Large board has no pool of unshot tiles - random tile is drawn again when it was shot. After RANDOM_TRIES
+    failed draws (board is almost shot through) it is scanned from random tile */
+
+    int parity = ai->odd_left ? 1 : 0;
+    COUNT(random_shots);
+    if (parity == 0) COUNT(parity_fallbacks);
+    for (int tries = 0; tries < RANDOM_TRIES; ++tries) {
+        _COORD aim = {random_below(&ai->rng, board_size), random_below(&ai->rng, board_size)};
+        if (parity && ((aim.x + aim.y) & 1) == 0) aim.x = aim.x ? aim.x - 1 : 1;    // odd neighbour
+        if (!sparse_get(&player_opponent->shots, aim.x, aim.y)) return aim;
+    }
+
+    unsigned int tiles = board_size * board_size;
+    unsigned int first = random_below(&ai->rng, tiles);
+    for (; parity >= 0; --parity) {     // count of odd tiles is only a hint - any tile is taken when none is left
+        for (unsigned int i = 0; i < tiles; ++i) {
+            _COORD aim = tile_coord((first + i) % tiles, board_size);
+            if ((!parity || ((aim.x + aim.y) & 1)) && !sparse_get(&player_opponent->shots, aim.x, aim.y)) return aim;
+        }
+        ai->odd_left = 0;
+    }
+    _COORD null_coord = NULL_COORD;     // whole board was shot (never happens in game)
+    return null_coord;
+}
+
+
+void large_ai_observe(LARGE_AI* ai, LARGE_PLAYER* player_opponent, _COORD aim, SHOT shot, unsigned int board_size) {
+    /* New HIT becomes open hit and tiles around it candidates. When ship was sunk, its tiles are not open anymore */
+
+    if (shot.flag != INVALID && ((aim.x + aim.y) & 1)) ai->odd_left--;
+    if (shot.sunk != NO_SHIP) {
+        for (int i = 0; i < ai->open_count; ++i) {
+            _COORD hit = tile_coord(ai->open_hits[i], board_size);
+            if (large_tile_state(player_opponent, hit.x, hit.y, board_size) == SUNK) ai->open_hits[i--] = ai->open_hits[--ai->open_count];
+        }
+        if (ai->open_count == 0) ai->candidate_count = 0;
+    }
+    else if (shot.flag == VALID_HIT && ai->open_count < FLEET_TILES) {
+        int tile = tile_index(aim.x, aim.y, board_size);
+        ai->open_hits[ai->open_count++] = tile;
+        large_push_neighbours(ai, player_opponent, tile, board_size);
+    }
+}
+
+
+int simulate_large_game(LARGE_SESSION* session, unsigned int board_size) {
+    /* Same as simulate_game on large board (only hunt/target AI). Returns number of shots fired by the winner */
+
+    LARGE_PLAYER* player1 = &session->players[0];
+    LARGE_PLAYER* player2 = &session->players[1];
+    int shots = 0;
+
+    reset_large_session(session);
+    large_ai_reset(&session->ai[0], board_size);
+    large_ai_reset(&session->ai[1], board_size);
+    large_placement(player1, &session->rng, board_size);
+    large_placement(player2, &session->rng, board_size);
+    seed_random(&session->ai[0].rng, next_random(&session->rng), 0);
+    seed_random(&session->ai[1].rng, next_random(&session->rng), 1);
+
+    while (1) {
+        shots++;    // both players fire once per round -> winner fired this many shots
+        if (large_computer_shot(player1, player2, &session->ai[0], board_size)) break;
+        if (large_computer_shot(player2, player1, &session->ai[1], board_size)) break;
+    }
+    return shots;
+}
+
+
+///////////////////////////////////////////////////
+///////////////////// SIMULATION //////////////////
+///////////////////////////////////////////////////
+
+
+int simulate_game(GAME* game, int ai_level) {
+    /* Plays one complete computer vs computer game without any console output. Game has to be started by caller
+    (game_start gives it board size and random stream), so the same seed plays the same game. Both players get
+    AI of given level and the game is stepped to its end - fleets are placed randomly and computers alternate
+    turns. Returns number of shots fired by the winner */
+
+    game_set_ai(game, 0, ai_level);
+    game_set_ai(game, 1, ai_level);
+    while (game_step(game));
+    return (game->shot_count + !game->winner) / 2;     // player 0 fires first
+}
+
+
+void simulate_games(unsigned long games, unsigned int board_size, int ai_level, uint64_t seed, const FLEET* fleet, SIM_STATS *stats) {
+    /* Library entry point of headless mode. Plays given number of games in one thread and fills stats
+    struct with number of games, shots needed to win (sum and histogram) and elapsed time */
+
+    run_tournament(games, board_size, ai_level, 1, seed, fleet, stats);
+}
+
+
+void print_simulation_stats(SIM_STATS *stats, unsigned int board_size) {
+    /* Prints summary of simulation - games per second, average shots to win and histogram
+    of shot counts (only non-empty rows are printed) */
+
+    printf("seed:            %llu\n", (unsigned long long)stats->seed);
+    printf("board size:      %u\n", board_size);
+    printf("fleet:          ");
+    for (int i = 0; i < stats->fleet.count; ++i) printf(" %d", SHIP_CLASSES[stats->fleet.classes[i]].size);
+    printf("\n");
+    printf("games:           %lu\n", stats->games);
+    printf("seconds:         %.3f\n", stats->seconds);
+    if (stats->seconds > 0) printf("games/s:         %.0f\n", stats->games / stats->seconds);
+    if (stats->games) printf("avg shots (win): %.2f\n", (double)stats->total_shots / stats->games);
+
+    printf("histogram (shots to win: games):\n");
+    for (int i = 0; i <= MAX_SHOTS; ++i) {
+        if (!stats->histogram[i]) continue;
+        if (i == MAX_SHOTS && board_size > MAX_BOARD) printf("%4d+: %lu\n", i, stats->histogram[i]);   // longer games of large board
+        else printf("%4d: %lu\n", i, stats->histogram[i]);
+    }
+}
+
+
+int headless_mode(int argc, char* argv[]) {
+    /* Parses command-line flags. '--simulate N' plays N computer vs computer games without any
+    terminal I/O, '--size N' sets board size (default 10), '--ai hunt|probability' level of both
+    computers, '--threads N' number of used cores (default all) and '--seed N' makes results
+    repeatable (default is time). '--ai montecarlo' samples fleets for '--budget MS' per move (or until
+    '--samples N'), in simulation with one thread per game. '--record FILE' appends all simulated games
+    to record file, '--scan FILE' prints summary of record file and '--analyze FILE' its statistics
+    as JSON (on '--threads' threads). '--concurrent K' plays simulation on scheduler, K games at once ('--compact' keeps them as compact sessions
+    restored for every slice). '--fleet 5,4,3,3,2' sets sizes of ships. '--bench' measures all benchmarks on every board size (or only
+    on the one given by '--size') and prints them as JSON. '--bot' plays as a bot of line protocol with AI
+    of '--ai' level. '--selftest' runs quick checks of generator, records, their analysis, compact sessions and bot. Sizes above MAX_BOARD (up to MAX_LARGE_BOARD)
+    are simulated with sparse state and hunt/target AI. Returns exit code of program */
+
+    unsigned long games = 0;
+    unsigned int board_size = 10;
+    int bench = 0, bot = 0, size_given = 0;
+    const char* record_path = NULL;
+    const char* analyze_path = NULL;
+    int concurrent = 0, compact = 0;
+    int ai_level = AI_HUNT_TARGET;
+    int threads = cpu_count();
+    uint64_t seed = time(NULL);
+    FLEET fleet = CLASSIC_FLEET;
+
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--simulate") && i + 1 < argc) games = strtoul(argv[++i], NULL, 10);
+        else if (!strcmp(argv[i], "--size") && i + 1 < argc) {
+            long size = strtol(argv[++i], NULL, 10);    // clamped while signed - "-3" is not a huge size
+            board_size = size < 5 ? 5 : size > MAX_LARGE_BOARD ? MAX_LARGE_BOARD : size;
+            size_given = 1;
+        }
+        else if (!strcmp(argv[i], "--bench")) bench = 1;
+        else if (!strcmp(argv[i], "--selftest")) return run_selftest();
+        else if (!strcmp(argv[i], "--bot")) bot = 1;
+        else if (!strcmp(argv[i], "--fleet") && i + 1 < argc) {
+            if (parse_fleet(argv[++i], &fleet)) {
+                fprintf(stderr, "fleet is a list of at most %d ship sizes 1..%d (e.g. 5,4,3,3,2)\n", MAX_FLEET, MAX_SHIP);
+                return 1;
+            }
+        }
+        else if (!strcmp(argv[i], "--threads") && i + 1 < argc) threads = strtol(argv[++i], NULL, 10);
+        else if (!strcmp(argv[i], "--seed") && i + 1 < argc) seed = strtoull(argv[++i], NULL, 10);
+        else if (!strcmp(argv[i], "--ai") && i + 1 < argc) {
+            i++;
+            if (!strcmp(argv[i], "probability")) ai_level = AI_PROBABILITY;
+            else if (!strcmp(argv[i], "montecarlo")) ai_level = AI_MONTE_CARLO;
+            else ai_level = AI_HUNT_TARGET;
+        }
+        else if (!strcmp(argv[i], "--budget") && i + 1 < argc) search_budget = strtod(argv[++i], NULL) / 1000;
+        else if (!strcmp(argv[i], "--samples") && i + 1 < argc) search_samples = strtoul(argv[++i], NULL, 10);
+        else if (!strcmp(argv[i], "--record") && i + 1 < argc) record_path = argv[++i];
+        else if (!strcmp(argv[i], "--scan") && i + 1 < argc) return scan_records(argv[++i]);
+        else if (!strcmp(argv[i], "--analyze") && i + 1 < argc) analyze_path = argv[++i];
+        else if (!strcmp(argv[i], "--concurrent") && i + 1 < argc) concurrent = strtol(argv[++i], NULL, 10);
+        else if (!strcmp(argv[i], "--compact")) compact = 1;
+        else {
+            fprintf(stderr, "usage: %s [--simulate GAMES | --bench | --bot | --selftest] [--size 5..%d] [--ai hunt|probability|montecarlo] [--budget MS] [--samples N] [--threads N] [--seed N] [--fleet SIZES] [--record FILE] [--scan FILE] [--analyze FILE] [--concurrent GAMES [--compact]]\n",
+                    argv[0], MAX_LARGE_BOARD);
+            return 1;
+        }
+    }
+    if (board_size > MAX_LARGE_BOARD) board_size = MAX_LARGE_BOARD;   // same limits as main menu
+    if (board_size < 5) board_size = 5;
+    if (threads > MAX_THREADS) threads = MAX_THREADS;
+    if (threads < 1) threads = 1;
+
+    if (bot) {
+        setvbuf(stdout, NULL, _IOFBF, BOT_BUFFER);     // answers leave in batches - nothing was written to stdout yet
+        return bot_mode(ai_level, seed, threads);   // sizes and fleets are given by arena
+    }
+    if (analyze_path) {
+        double start = wall_time();
+        ANALYSIS* analysis = analyze_records(analyze_path, threads);
+        if (!analysis) {
+            fprintf(stderr, "%s is not a file of game records\n", analyze_path);
+            return 1;
+        }
+        print_analysis(analysis, wall_time() - start);
+        free(analysis);
+        return 0;
+    }
+    if (board_size > MAX_BOARD && (bench || concurrent || ai_level != AI_HUNT_TARGET)) {
+        fprintf(stderr, "boards bigger than %d support only simulation with '--ai hunt' (without '--concurrent')\n", MAX_BOARD);
+        return 1;
+    }
+    if (bench) {
+        if (size_given) run_benchmarks(board_size, board_size, seed);
+        else run_benchmarks(5, MAX_BOARD, seed);
+        return 0;
+    }
+    if (games == 0) {
+        fprintf(stderr, "nothing to do - use '--simulate GAMES', '--bench' or '--bot'\n");
+        return 1;
+    }
+    if (!fleet_fits(&fleet, board_size)) {
+        fprintf(stderr, "fleet does not fit to board of size %u\n", board_size);
+        return 1;
+    }
+
+    if (record_path && board_size > MAX_BOARD) {
+        fprintf(stderr, "games are recorded only on boards up to %d\n", MAX_BOARD);
+        return 1;
+    }
+    if (record_path && !(simulation_archive = archive_open(record_path))) {
+        fprintf(stderr, "%s cannot be opened as a file of game records\n", record_path);
+        return 1;
+    }
+
+    SIM_STATS stats;
+    if (concurrent && compact) run_hosted(games, board_size, ai_level, threads, concurrent, seed, &fleet, &stats);
+    else if (concurrent) run_interleaved(games, board_size, ai_level, threads, concurrent, seed, &fleet, &stats);
+    else run_tournament(games, board_size, ai_level, threads, seed, &fleet, &stats);
+    printf("threads:         %d\n", threads);
+    print_simulation_stats(&stats, board_size);
+    if (simulation_archive) archive_close(simulation_archive);
+    return 0;
+}
+
+
+int parse_fleet(const char* text, FLEET* fleet) {
+    /* Reads comma separated sizes of ships (e.g. "5,4,3,3,2"). Each ship gets the first class of its size,
+    so names in tables may repeat. Returns 0 on success, 1 if the list is not valid */
+
+    fleet->count = 0;
+    while (*text) {
+        char* end;
+        long size = strtol(text, &end, 10);
+        if (end == text || size < 1 || size > MAX_SHIP || fleet->count == MAX_FLEET) return 1;
+
+        int ship_class = 0;
+        while (SHIP_CLASSES[ship_class].size != size) ship_class++;     // every size 1..MAX_SHIP has a class
+        fleet->classes[fleet->count++] = ship_class;
+
+        text = end;
+        if (*text == ',') text++;
+        else if (*text) return 1;
+    }
+    return fleet->count == 0;
+}
+
+
+///////////////////////////////////////////////////
+/////////////////// BOT PROTOCOL //////////////////
+///////////////////////////////////////////////////
+
+
+int bot_mode(int ai_level, uint64_t seed, int threads) {
+    /* Plays as a bot of line protocol on stdin/stdout, so external AIs can be pitted against this one by an arena.
+    Every command names its game, so one process plays many games at once. All complete commands which arrived
+    are answered before answers are flushed - arena can send commands of many games without waiting for answers,
+    and pays for one write and one read per batch instead of per move (stdout is made fully buffered by caller
+    before anything is written to it). Returns exit code of program */
+
+    static char input[BOT_BUFFER];
+    size_t length = 0;
+    BOT* bot = (BOT*) calloc(1, sizeof(BOT));
+    bot->ai_level = ai_level;
+    bot->threads = threads;
+    bot->seed = seed;
+
+    int quit = 0, discarding = 0;
+    while (!quit) {
+        size_t start = 0;
+        char* end;
+        if (discarding) {   // rest of line longer than buffer
+            end = memchr(input, '\n', length);
+            start = end ? (size_t)(end - input + 1) : length;
+            discarding = !end;
+        }
+        while (!discarding && !quit && (end = memchr(input + start, '\n', length - start))) {
+            *end = '\0';
+            quit = bot_command(bot, input + start);
+            start = end - input + 1;
+        }
+        memmove(input, input + start, length - start);
+        length -= start;
+        fflush(stdout);     // everything sent so far is answered
+
+        if (length == BOT_BUFFER - 1) {     // line longer than buffer is dropped up to its end
+            printf("error - line longer than %d bytes\n", BOT_BUFFER - 1);
+            fflush(stdout);
+            length = 0;
+            discarding = 1;
+        }
+        long received = quit ? 0 : bot_read(input + length, BOT_BUFFER - 1 - length);
+        if (received <= 0) break;   // end of input
+        length += received;
+    }
+
+    for (int i = 0; i < MAX_BOT_GAMES; ++i) {
+        if (bot->games[i]) game_free(bot->games[i]);
+    }
+    free(bot);
+    return 0;
+}
+
+
+long bot_read(char* buffer, size_t size) {
+    /* Reads whatever arena has sent (at least one byte, at most size). Returns 0 at the end of input */
+
+#if defined(__unix__) || defined(__APPLE__)
+    long received;
+    do received = read(STDIN_FILENO, buffer, size);    // all of the pipe at once
+    while (received < 0 && errno == EINTR);
+    return received;
+#else
+    if (!fgets(buffer, size, stdin)) return 0;  // one line at a time
+    return strlen(buffer);
+#endif
+}
+
+
+int bot_command(BOT* bot, char* line) {
+    /* Executes one command of protocol. Answers and errors are written to stdout. Returns 1 on 'quit', else 0 */
+
+    char* word[BOT_WORDS];
+    int count = 0;
+    for (char* token = strtok(line, " \t\r"); token && count < BOT_WORDS; token = strtok(NULL, " \t\r")) word[count++] = token;
+    if (count == 0) return 0;   // empty line
+
+    if (!strcmp(word[0], "quit")) return 1;
+    if (!strcmp(word[0], "ping")) {
+        printf("pong%s%s\n", count > 1 ? " " : "", count > 1 ? word[1] : "");
+        return 0;
+    }
+
+    int known = !strcmp(word[0], "new") || !strcmp(word[0], "place") || !strcmp(word[0], "shoot")
+                || !strcmp(word[0], "result") || !strcmp(word[0], "over");
+    if (!known) {
+        printf("error - unknown command '%s'\n", word[0]);
+        return 0;
+    }
+    if (count < 2) {
+        printf("error - '%s' needs id of game\n", word[0]);
+        return 0;
+    }
+
+    GAME* game = bot_game(bot, word[1], strcmp(word[0], "new"));
+    if (!game) return 0;
+    int id = strtol(word[1], NULL, 10);
+
+    if (!strcmp(word[0], "new")) bot_new(bot, game, id, word, count);
+    else if (!strcmp(word[0], "place")) bot_place(game, id);
+    else if (!strcmp(word[0], "shoot")) bot_shoot(bot, game, id);
+    else if (!strcmp(word[0], "result")) bot_result(bot, game, id, word, count);
+    else bot->active[id] = 0;   // 'over' - game is kept for next 'new' with the same id
+    return 0;
+}
+
+
+GAME* bot_game(BOT* bot, const char* id_text, int active) {
+    /* Returns game of given id. Game of 'new' (active = 0) is allocated when the id is used for the first time,
+    other commands need running game. Prints error and returns NULL if there is no such game */
+
+    char* end;
+    long id = strtol(id_text, &end, 10);
+    if (*end || id < 0 || id >= MAX_BOT_GAMES) {
+        printf("error - id must be 0 to %d\n", MAX_BOT_GAMES - 1);     // no valid id to answer with
+        return NULL;
+    }
+    if (active && !bot->active[id]) {
+        printf("error %ld no such game\n", id);
+        return NULL;
+    }
+    if (!bot->games[id]) bot->games[id] = game_create(&CLASSIC_FLEET);
+    return bot->games[id];
+}
+
+
+void bot_new(BOT* bot, GAME* game, int id, char* word[], int count) {
+    /* 'new ID SIZE [SIZES]' - starts game on board of given size with classic fleet or fleet of given ship sizes
+    (e.g. 5,4,3,3,2), both players have the same fleet. Bot places its fleet at once. Nothing is answered */
+
+    FLEET fleet = CLASSIC_FLEET;
+    unsigned int board_size = count > 2 ? strtoul(word[2], NULL, 10) : 0;
+    bot->active[id] = 0;
+    bot->pending[id] = NO_SHOT;
+
+    if (count > 3 && parse_fleet(word[3], &fleet)) {
+        printf("error %d fleet is a list of at most %d ship sizes 1..%d\n", id, MAX_FLEET, MAX_SHIP);
+        return;
+    }
+    if (board_size < 5 || board_size > MAX_BOARD || !fleet_fits(&fleet, board_size)) {
+        printf("error %d size must be 5 to %d and fleet has to fit\n", id, MAX_BOARD);
+        return;
+    }
+    game_set_fleet(game, &fleet);
+    game_start(game, board_size, bot->seed, bot->started++);
+    game_set_ai(game, 0, bot->ai_level);    // bot is player 0, its opponent is only known from results
+    game_set_search(game, 0, search_budget, search_samples, bot->threads);
+    game_place_random(game, 0);
+    game_begin(game);
+    bot->active[id] = 1;
+}
+
+
+void bot_place(GAME* game, int id) {
+    /* 'place ID' - answers 'place ID' followed by TOP or LEFT end and orientation of every ship in order of fleet */
+
+    PLAYER* player = &game->session.players[0];
+    char name[16];
+    printf("place %d", id);
+    for (int i = 0; i < player->fleet_size; ++i) {
+        coord_name(name, player->ships[i].origin, game->board_size);
+        printf(" %s %c", name, player->ships[i].orientation == HORIZONTAL ? 'H' : 'V');
+    }
+    printf("\n");
+}
+
+
+void bot_shoot(BOT* bot, GAME* game, int id) {
+    /* 'shoot ID' - answers 'shot ID COORD' with tile chosen by AI (arena answers with 'result'). The tile is
+    pending until its result comes */
+
+    AI* ai = &game->ai[0];
+    char name[16];
+    if (ai->pool_count[0] + ai->pool_count[1] == 0) {
+        printf("error %d every tile was shot\n", id);
+        return;
+    }
+    _COORD aim = game_ai_move(game);
+    bot->pending[id] = tile_index(aim.x, aim.y, game->board_size);
+    coord_name(name, bot->pending[id], game->board_size);
+    printf("shot %d %s\n", id, name);
+}
+
+
+void bot_result(BOT* bot, GAME* game, int id, char* word[], int count) {
+    /* 'result ID COORD miss|hit' or 'result ID COORD sunk ORIGIN H|V SIZE' - result of bot's last shot. Sunk ship
+    is given by its TOP or LEFT end, orientation and size. Result of any other tile is rejected. Nothing is
+    answered */
+
+    _COORD aim, origin;
+    SHIP ship;
+    int flag = INVALID;
+
+    if (count < 4 || parse_coord(word[2], &aim)) {
+        printf("error %d result needs coordinates and miss, hit or sunk\n", id);
+        return;
+    }
+    if (aim.x >= game->board_size || aim.y >= game->board_size || tile_index(aim.x, aim.y, game->board_size) != bot->pending[id]) {
+        printf("error %d result of tile which was not shot\n", id);
+        return;
+    }
+    if (!strcmp(word[3], "miss")) flag = VALID_MISS;
+    else if (!strcmp(word[3], "hit") || !strcmp(word[3], "sunk")) flag = VALID_HIT;
+
+    int sunk = !strcmp(word[3], "sunk");
+    if (sunk) {
+        if (count < 7 || parse_coord(word[4], &origin)) flag = INVALID;
+        else {
+            ship.x = origin.x;
+            ship.y = origin.y;
+            ship.orientation = toupper((unsigned char)word[5][0]) == 'V' ? VERTICAL : HORIZONTAL;
+            ship.size = strtoul(word[6], NULL, 10);
+        }
+    }
+    if (flag == INVALID || game_record(game, aim, flag, sunk ? &ship : NULL)) printf("error %d result rejected\n", id);
+    else bot->pending[id] = NO_SHOT;
+}
+
+
+///////////////////////////////////////////////////
+///////////////////// TOURNAMENT //////////////////
+///////////////////////////////////////////////////
+
+
+void run_tournament(unsigned long games, unsigned int board_size, int ai_level, int threads, uint64_t seed, const FLEET* fleet, SIM_STATS *stats) {
+    /* Splits games evenly between workers (one per thread). Worker which runs out of games steals
+    half of remaining games of another worker. Each worker has its own session and statistics, which
+    are merged when all threads are finished - no locks while playing. Game n is always played with
+    stream n of given seed, so results do not depend on number of threads or on stealing */
+
+    if (games > UINT32_MAX) games = UINT32_MAX;    // game indexes are packed to 32 bits
+    WORKER* workers = (WORKER*) ALIGNED_ALLOC(sizeof(WORKER) * threads);
+
+    for (int i = 0; i < threads; ++i) {
+        uint64_t first = games * i / threads;
+        uint64_t end = games * (i + 1) / threads;
+        atomic_init(&workers[i].queue, first | end << 32);
+        memset(&workers[i].stats, 0, sizeof(SIM_STATS));
+        workers[i].seed = seed;
+        workers[i].fleet = fleet;
+        workers[i].board_size = board_size;
+        workers[i].ai_level = ai_level;
+        workers[i].id = i;
+        workers[i].threads = threads;
+        workers[i].workers = workers;
+    }
+
+    double start = wall_time();
+#ifdef HAS_THREADS
+    thrd_t thread[MAX_THREADS];
+    for (int i = 1; i < threads; ++i) thrd_create(&thread[i], tournament_worker, &workers[i]);
+    tournament_worker(&workers[0]);     // main thread works too
+    for (int i = 1; i < threads; ++i) thrd_join(thread[i], NULL);
+#else
+    for (int i = 0; i < threads; ++i) tournament_worker(&workers[i]);   // no threads - one after another
+#endif
+
+    memset(stats, 0, sizeof(SIM_STATS));
+    for (int i = 0; i < threads; ++i) {     // merging results
+        stats->games += workers[i].stats.games;
+        stats->total_shots += workers[i].stats.total_shots;
+        for (int j = 0; j <= MAX_SHOTS; ++j) stats->histogram[j] += workers[i].stats.histogram[j];
+    }
+    stats->seconds = wall_time() - start;
+    stats->seed = seed;
+    stats->fleet = *fleet;
+    ALIGNED_FREE(workers);
+}
+
+
+int tournament_worker(void* arg) {
+    /* Body of one thread. Plays games from own queue, when it is empty tries to steal
+    from others. Returns when there is nothing left to play or steal */
+
+    WORKER* worker = (WORKER*) arg;
+    int large = worker->board_size > MAX_BOARD;    // sparse session with hunt/target AI
+    GAME* game = large ? NULL : game_create(worker->fleet);
+    if (game && simulation_archive) game_set_archive(game, simulation_archive);   // own buffer, shared file
+    LARGE_SESSION* large_session = large ? create_large_session(worker->fleet) : NULL;
+    unsigned int first, count;
+
+    while (take_games(worker, &first, &count) || steal_games(worker)) {
+        for (unsigned int i = 0; i < count; ++i) {
+            int shots;
+            if (large) {
+                seed_random(&large_session->rng, worker->seed, first + i);
+                shots = simulate_large_game(large_session, worker->board_size);
+            }
+            else {
+                game_start(game, worker->board_size, worker->seed, first + i);
+                shots = simulate_game(game, worker->ai_level);
+            }
+            worker->stats.games++;
+            worker->stats.total_shots += shots;
+            worker->stats.histogram[shots < MAX_SHOTS ? shots : MAX_SHOTS]++;   // last bucket holds longer games
+        }
+        count = 0;
+    }
+    if (game) game_free(game);
+    if (large_session) free_large_session(large_session);
+    return 0;
+}
+
+
+int take_games(WORKER* worker, unsigned int* first, unsigned int* count) {
+    /* Owner takes up to STEAL_CHUNK games from the beginning of his queue. Returns 0 if queue is empty */
+
+    uint64_t queue = atomic_load(&worker->queue);
+    while (1) {
+        uint32_t begin = (uint32_t)queue, end = (uint32_t)(queue >> 32);
+        if (begin >= end) return 0;
+
+        uint32_t taken = end - begin < STEAL_CHUNK ? end - begin : STEAL_CHUNK;
+        uint64_t rest = (uint64_t)(begin + taken) | (uint64_t)end << 32;
+        if (atomic_compare_exchange_weak(&worker->queue, &queue, rest)) {   // nobody stole meanwhile
+            *first = begin;
+            *count = taken;
+            return 1;
+        }
+    }
+}
+
+
+int steal_games(WORKER* thief) {
+    /* Goes through other workers and moves upper half of the first non-empty queue
+    into thief's (empty) queue. Returns 0 if all queues are empty */
+
+    for (int i = 1; i < thief->threads; ++i) {
+        WORKER* victim = &thief->workers[(thief->id + i) % thief->threads];
+        uint64_t queue = atomic_load(&victim->queue);
+
+        while (1) {
+            uint32_t begin = (uint32_t)queue, end = (uint32_t)(queue >> 32);
+            if (begin >= end) break;    // nothing to steal here
+
+            uint32_t middle = end - (end - begin + 1) / 2;  // thief gets at least one game
+            uint64_t rest = (uint64_t)begin | (uint64_t)middle << 32;
+            if (atomic_compare_exchange_weak(&victim->queue, &queue, rest)) {
+                atomic_store(&thief->queue, (uint64_t)middle | (uint64_t)end << 32);
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+
+int cpu_count() {
+    /* Returns number of available CPU cores (1 if it cannot be found out) */
+
+    int result = 1;
+#if defined(_SC_NPROCESSORS_ONLN)
+    result = sysconf(_SC_NPROCESSORS_ONLN);
+#elif defined(_WIN32)
+    char* cores = getenv("NUMBER_OF_PROCESSORS");
+    if (cores) result = strtol(cores, NULL, 10);
+#endif
+    return result > 0 ? result : 1;
+}
+
+
+double wall_time() {
+    /* Returns real time in seconds - clock() would sum time of all threads */
+
+    struct timespec now;
+    timespec_get(&now, TIME_UTC);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+
+///////////////////////////////////////////////////
+///////////////////// SCHEDULER ///////////////////
+///////////////////////////////////////////////////
+
+
+SCHEDULER* scheduler_create(int threads, int capacity, void (*finished)(SCHEDULER* scheduler, GAME* game), void* context) {
+    /* Starts scheduler of up to capacity games on fixed number of threads. Threads take queued games and step
+    them in turns (SCHEDULER_SLICE steps each), so many games - simulations, bots or human sessions - share few
+    threads. Game which awaits human input leaves the queue until its owner adds it again; finished game is
+    given to finished callback. Without C11 threads the games are stepped in scheduler_wait */
+
+    SCHEDULER* scheduler = (SCHEDULER*) calloc(1, sizeof(SCHEDULER));
+    scheduler->queue = (GAME**) malloc(sizeof(GAME*) * capacity);
+    scheduler->capacity = capacity;
+    scheduler->finished = finished;
+    scheduler->context = context;
+#ifdef HAS_THREADS
+    mtx_init(&scheduler->lock, mtx_plain);
+    cnd_init(&scheduler->wake);
+    cnd_init(&scheduler->idle);
+    if (threads > MAX_THREADS) threads = MAX_THREADS;
+    for (int i = 0; i < threads; ++i) {
+        if (thrd_create(&scheduler->threads[i], scheduler_worker, scheduler) != thrd_success) break;
+        scheduler->thread_count++;
+    }
+#endif
+    return scheduler;
+}
+
+
+void scheduler_add(SCHEDULER* scheduler, GAME* game) {
+    /* Queues game which can step (new game or game which got human input) */
+
+#ifdef HAS_THREADS
+    mtx_lock(&scheduler->lock);
+#endif
+    scheduler->queue[(scheduler->head + scheduler->count++) % scheduler->capacity] = game;
+#ifdef HAS_THREADS
+    cnd_signal(&scheduler->wake);
+    mtx_unlock(&scheduler->lock);
+#endif
+}
+
+
+void scheduler_wait(SCHEDULER* scheduler) {
+    /* Returns when no game can step - all games are finished or await human input */
+
+#ifdef HAS_THREADS
+    if (scheduler->thread_count) {
+        mtx_lock(&scheduler->lock);
+        while (scheduler->count || scheduler->stepping) cnd_wait(&scheduler->idle, &scheduler->lock);
+        mtx_unlock(&scheduler->lock);
+        return;
+    }
+#endif
+    while (scheduler->count) {  // no threads - caller steps games
+        GAME* game = scheduler->queue[scheduler->head];
+        scheduler->head = (scheduler->head + 1) % scheduler->capacity;
+        scheduler->count--;
+        if (scheduler_run(scheduler, game)) scheduler_add(scheduler, game);
+    }
+}
+
+
+void scheduler_free(SCHEDULER* scheduler) {
+    /* Stops threads (after they finish games they are stepping) and frees scheduler. Games are not freed */
+
+#ifdef HAS_THREADS
+    mtx_lock(&scheduler->lock);
+    scheduler->stopping = 1;
+    cnd_broadcast(&scheduler->wake);
+    mtx_unlock(&scheduler->lock);
+    for (int i = 0; i < scheduler->thread_count; ++i) thrd_join(scheduler->threads[i], NULL);
+    mtx_destroy(&scheduler->lock);
+    cnd_destroy(&scheduler->wake);
+    cnd_destroy(&scheduler->idle);
+#endif
+    free(scheduler->queue);
+    free(scheduler);
+}
+
+
+int scheduler_worker(void* arg) {
+    /* Body of scheduler thread. Takes games from queue until scheduler stops */
+
+#ifdef HAS_THREADS
+    SCHEDULER* scheduler = (SCHEDULER*) arg;
+    mtx_lock(&scheduler->lock);
+    while (1) {
+        while (!scheduler->count && !scheduler->stopping) cnd_wait(&scheduler->wake, &scheduler->lock);
+        if (scheduler->stopping) break;
+
+        GAME* game = scheduler->queue[scheduler->head];
+        scheduler->head = (scheduler->head + 1) % scheduler->capacity;
+        scheduler->count--;
+        scheduler->stepping++;
+        mtx_unlock(&scheduler->lock);
+
+        int again = scheduler_run(scheduler, game);
+
+        mtx_lock(&scheduler->lock);
+        if (again) {
+            scheduler->queue[(scheduler->head + scheduler->count++) % scheduler->capacity] = game;
+            cnd_signal(&scheduler->wake);
         }
-    if (flag == 0) {    // newly sunk ship found
-        for (int i = 0; i < 2; ++i) *player_opponent.patrol_boat[i] = SUNK;
-        return 1;
+        scheduler->stepping--;
+        if (!scheduler->count && !scheduler->stepping) cnd_broadcast(&scheduler->idle);
     }
+    mtx_unlock(&scheduler->lock);
+#endif
     return 0;
 }
 
 
-int victory_check(PLAYER player_opponent) {
-    /* Goes through all opponents ships. If it finds active ship , function returns 0 (didn't win).
-    If all ships are SUNK, enemy fleet is sunk (win) and functions return 1 */
+int scheduler_run(SCHEDULER* scheduler, GAME* game) {
+    /* Steps game up to SCHEDULER_SLICE times. Returns 1 if it can step further (goes back to queue).
+    Finished game is given to finished callback */
 
-    // check Carrier
-    if (*player_opponent.carrier[0] != SUNK) return 0;
-    // check Battleship
-    if (*player_opponent.battleship[0] != SUNK) return 0;
-    // check Destroyer
-    if (*player_opponent.destroyer[0] != SUNK) return 0;
-    // check Submarine
-    if (*player_opponent.submarine[0] != SUNK) return 0;
-    // check Patrol Boat
-    if (*player_opponent.patrol_boat[0] != SUNK) return 0;
+    for (int i = 0; i < SCHEDULER_SLICE; ++i) {
+        if (game_step(game)) continue;
+        if (game_phase(game) == PHASE_FINISHED && scheduler->finished) scheduler->finished(scheduler, game);
+        return 0;   // finished or awaits human
+    }
     return 1;
 }
 
 
+void run_interleaved(unsigned long games, unsigned int board_size, int ai_level, int threads, int concurrent, uint64_t seed, const FLEET* fleet, SIM_STATS *stats) {
+    /* Same as run_tournament, but games are stepped by scheduler - up to concurrent games are played at once,
+    each gets the next game index when it finishes. Game n is played with stream n of seed, so results are the
+    same as of run_tournament. Each game slot has its own statistics, merged at the end */
+
+    if (concurrent < 1) concurrent = 1;
+    if ((unsigned long)concurrent > games) concurrent = games ? games : 1;
+
+    INTERLEAVED run = {0, games, board_size, ai_level, seed};
+    atomic_init(&run.next, concurrent);
+    GAME** slots = (GAME**) malloc(sizeof(GAME*) * concurrent);
+    SIM_STATS* slot_stats = (SIM_STATS*) calloc(concurrent, sizeof(SIM_STATS));
+
+    double start = wall_time();
+    SCHEDULER* scheduler = scheduler_create(threads, concurrent, interleaved_finished, &run);
+    for (int i = 0; i < concurrent; ++i) {
+        slots[i] = game_create(fleet);
+        slots[i]->context = &slot_stats[i];
+        if ((unsigned long)i < games) {
+            interleaved_start(&run, slots[i], i);
+            scheduler_add(scheduler, slots[i]);
+        }
+    }
+    scheduler_wait(scheduler);
+    scheduler_free(scheduler);
+
+    memset(stats, 0, sizeof(SIM_STATS));
+    for (int i = 0; i < concurrent; ++i) {     // merging results
+        stats->games += slot_stats[i].games;
+        stats->total_shots += slot_stats[i].total_shots;
+        for (int j = 0; j <= MAX_SHOTS; ++j) stats->histogram[j] += slot_stats[i].histogram[j];
+        game_free(slots[i]);
+    }
+    stats->seconds = wall_time() - start;
+    stats->seed = seed;
+    stats->fleet = *fleet;
+    free(slot_stats);
+    free(slots);
+}
+
+
+void interleaved_start(INTERLEAVED* run, GAME* game, unsigned long index) {
+    /* Starts game with given index of interleaved simulation (computer vs computer) */
+
+    game_start(game, run->board_size, run->seed, index);
+    game_set_ai(game, 0, run->ai_level);
+    game_set_ai(game, 1, run->ai_level);
+}
+
+
+void interleaved_finished(SCHEDULER* scheduler, GAME* game) {
+    /* Finished callback of interleaved simulation - counts game to statistics of its slot
+    and starts next game in the same slot */
+
+    INTERLEAVED* run = (INTERLEAVED*) scheduler->context;
+    SIM_STATS* stats = (SIM_STATS*) game->context;
+    unsigned int shots = (game->shot_count + !game->winner) / 2;     // player 0 fires first
+    stats->games++;
+    stats->total_shots += shots;
+    stats->histogram[shots < MAX_SHOTS ? shots : MAX_SHOTS]++;
+
+    unsigned long next = atomic_fetch_add(&run->next, 1);
+    if (next >= run->games) return;
+    interleaved_start(run, game, next);
+    scheduler_add(scheduler, game);
+}
+
+
 ///////////////////////////////////////////////////
-//////////////////////// AI ///////////////////////
+///////////////// COMPACT SESSIONS ////////////////
 ///////////////////////////////////////////////////
 
 
-int computer_turn(PLAYER* player_active, PLAYER* player_opponent, unsigned int board_size, _COORD *focused_target) {
-    /* Computer tires to shoot at calculated position (recalculates when impossible). If victory conditions
-    are met, 'lost scree' from opponents (user's) perspective is printed */
+size_t compact_size(unsigned int board_size, int fleet_count) {
+    /* Bytes of COMPACT for given board and fleet. Header is followed by 3 bytes per ship of both players (class |
+    orientation << 7, origin) and by board_size^2 tiles per player - his shots from the front and candidates
+    of his AI from the back (one byte per tile on boards up to 16x16, else two). Nobody shoots a tile twice
+    and candidates are tiles not shot yet, so both always fit. 456 bytes for classic 10x10 game */
 
-    _COORD aim;
-    int flag;
-
-    aim = calculate_shot(player_active, player_opponent, board_size, focused_target);
-    flag = fire(*player_opponent, aim, board_size);
-    while(flag == INVALID) {    // recalculates coordinates until valid shot
-        aim = calculate_shot(player_active, player_opponent, board_size, focused_target);
-        flag = fire(*player_opponent, aim, board_size);
-    }
-    player_active->last_shot = &(player_opponent->player_board[aim.x][aim.y]);
-
-    if (flag == VALID_HIT) {
-        if (ship_hit_check(*player_opponent))
-            if (victory_check(*player_opponent)) {  // human is the opponent - his board goes first
-                default_screen(*player_opponent, *player_active, board_size);
-                printf(BRIGHT_RED_COLOR"\n\t###################################\n");
-                printf("\t###################################\n");
-                printf("\t     ------- YOU LOST! -------\n");
-                printf("\t###################################\n");
-                printf("\t###################################\n");
+    int tile_bytes = board_size * board_size > 256 ? 2 : 1;
+    size_t size = sizeof(COMPACT) + 2 * fleet_count * 3 + 2 * board_size * board_size * tile_bytes;
+    return (size + 7) & ~(size_t)7;     // objects of slab stay aligned for uint64_t
+}
+
+
+void game_compact(GAME* game, COMPACT* compact) {
+    /* Saves game to compact state (compact_size bytes), which has no pointers - it can be copied with memcpy as
+    a snapshot and game_restore continues it exactly. Everything else (boards, tile index, tables of AI) follows
+    from fleets and shots. Running speculation is finished first. Fleet which is being placed is not saved */
+
+    speculation_join(game);
+    unsigned int board_size = game->board_size;
+    int tiles = board_size * board_size;
+    int tile_bytes = tiles > 256 ? 2 : 1;
+    int fleet_count = game->session.fleet.count;
+
+    memset(compact, 0, sizeof(COMPACT));
+    compact->seed = game->seed;
+    compact->stream = game->stream;
+    compact->rng = game->session.rng;
+    compact->shot_count = game->shot_count;
+    compact->speculated = NO_COORD;
+    compact->board_size = board_size;
+    compact->fleet_count = fleet_count;
+    compact->phase = game->phase;
+    compact->placed = game->placed[0] | game->placed[1] << 1;
+
+    unsigned char* ships = compact->data;
+    for (int player = 0; player < 2; ++player) {
+        PLAYER* owner = &game->session.players[player];
+        memcpy(compact->nick[player], owner->nick, MAX_NAME);
+        for (int id = 0; id < fleet_count; ++id, ships += 3) {
+            FLEET_SHIP* ship = &owner->ships[id];
+            ships[0] = ship->ship_class | (game->placed[player] ? ship->orientation << 7 : 0);
+            put_bytes(ships + 1, game->placed[player] ? ship->origin : 0, 2);
+        }
+    }
+
+    for (int player = 0; player < 2; ++player) {
+        unsigned char* region = compact->data + 2 * fleet_count * 3 + player * tiles * tile_bytes;
+        for (int i = player, n = 0; i < game->shot_count; i += 2, ++n) put_bytes(region + n * tile_bytes, game->shots[i], tile_bytes);
+
+        compact->ai_level[player] = game->ai_level[player];
+        if (game->ai_level[player] == AI_NONE) continue;
+        AI* ai = &game->ai[player];
+        compact->ai_rng[player] = ai->rng;
+        compact->budget[player] = ai->budget;
+        compact->samples[player] = ai->sample_limit;
+        compact->threads[player] = ai->threads;
+
+        // candidates from the top of stack, each only once - shot and repeated ones are only skipped by AI
+        BOARD* board = game->session.players[!player].player_board;
+        uint64_t seen[BOARD_WORDS] = {0};
+        int count = 0;
+        for (int i = ai->candidate_count - 1; i >= 0; --i) {
+            int tile = ai->candidates[i];
+            if (tile_shot(board, tile) || bit_get(seen, tile)) continue;
+            bit_set(seen, tile);
+            count++;
+            put_bytes(region + (tiles - count) * tile_bytes, tile, tile_bytes);
+        }
+        compact->candidate_count[player] = count;
+    }
+
+    if (game->speculation_ready) {
+        compact->speculated = tile_index(game->speculated.x, game->speculated.y, board_size);
+        compact->speculated_player = game->speculated_player;
+    }
+}
+
+
+int game_restore(GAME* game, const COMPACT* compact) {
+    /* Continues game saved by game_compact in given game (any fleet). Fleets are placed again and all shots are
+    fired again in order, so boards and AIs are rebuilt by the same engine functions as in original game -
+    then generators and candidates of AIs are set back. Archive of game is kept, games are recorded only when
+    they end here. Learned statistics are not saved - game_set_learned has to be called again.
+    Returns 1 if compact state is not valid, else 0 */
+
+    unsigned int board_size = compact->board_size;
+    int tiles = board_size * board_size;
+    int tile_bytes = tiles > 256 ? 2 : 1;
+    FLEET fleet = {compact->fleet_count, {0}};
+    if (fleet.count > MAX_FLEET) return 1;
+    for (int id = 0; id < fleet.count; ++id) {
+        fleet.classes[id] = compact->data[3 * id] & 0x7F;
+        if (fleet.classes[id] >= CLASS_COUNT) return 1;     // unknown class of ship
+    }
+
+    game_set_fleet(game, &fleet);
+    if (game_start(game, board_size, compact->seed, compact->stream)) return 1;
+    for (int player = 0; player < 2; ++player) {
+        memcpy(game->session.players[player].nick, compact->nick[player], MAX_NAME);
+        if (compact->ai_level[player] != AI_NONE) {
+            game_set_ai(game, player, compact->ai_level[player]);
+            game_set_search(game, player, compact->budget[player], compact->samples[player], compact->threads[player]);
+        }
+        if (!(compact->placed >> player & 1)) continue;
+        const unsigned char* ships = compact->data + player * fleet.count * 3;
+        for (int id = 0; id < fleet.count; ++id, ships += 3) {
+            int origin = get_bytes(ships + 1, 2);
+            SHIP ship = {ships[0] >> 7, 0, origin % board_size, origin / board_size};
+            if (game_place_ship(game, player, id, ship)) return 1;
+        }
+        game->placed[player] = 1;
+    }
+
+    const unsigned char* regions = compact->data + 2 * fleet.count * 3;
+    if (compact->phase != PHASE_PLACEMENT) {
+        ARCHIVE* archive = game->archive;
+        game->archive = NULL;   // game was recorded already if it ended
+        game->phase = PHASE_SHOOTING;
+        for (int i = 0; i < compact->shot_count; ++i) {
+            int tile = get_bytes(regions + ((i & 1) * tiles + i / 2) * tile_bytes, tile_bytes);
+            if (game_fire(game, tile_coord(tile, board_size)).flag == INVALID) {
+                game->archive = archive;
                 return 1;
             }
+        }
+        game->archive = archive;
+    }
+
+    game->session.rng = compact->rng;
+    for (int player = 0; player < 2; ++player) {
+        if (compact->ai_level[player] == AI_NONE) continue;
+        AI* ai = &game->ai[player];
+        const unsigned char* region = regions + player * tiles * tile_bytes;
+        ai->rng = compact->ai_rng[player];
+        ai->candidate_count = compact->candidate_count[player];
+        for (int i = 0; i < ai->candidate_count; ++i) ai->candidates[i] = get_bytes(region + (tiles - ai->candidate_count + i) * tile_bytes, tile_bytes);
+    }
+    if (compact->speculated != NO_COORD) {
+        game->speculation_ready = 1;
+        game->speculated_player = compact->speculated_player;
+        game->speculated = tile_coord(compact->speculated, board_size);
     }
     return 0;
 }
 
 
-_COORD calculate_shot(PLAYER* player_active, PLAYER* player_opponent, unsigned int board_size, _COORD *focused_target) {
-    /* Tries to find enemy ship. Function sets target (last HIT). It strikes around the current target. When two HITs
-    are next to each other, functions follows the line. AI always tries to sink targeted ship. If there is no HIT
-    on the board, random coordinates will be generated */
+SLAB* slab_create(size_t object_size) {
+    /* Creates pool of objects of one size. Objects are cut from blocks of SLAB_OBJECTS, so 100 000 compact
+    sessions take a hundred allocations and lie next to each other. Pool is not locked - one thread takes
+    and gives back objects */
 
-    if (player_opponent->player_board[focused_target->x][focused_target->y] != HIT)   // no active target
-        *focused_target = find_last_hit(player_opponent, board_size);   // finds new target
+    SLAB* pool = (SLAB*) calloc(1, sizeof(SLAB));
+    if (object_size < sizeof(void*)) object_size = sizeof(void*);
+    pool->object_size = (object_size + 7) & ~(size_t)7;
+    return pool;
+}
 
-    if (focused_target->x == 27 && focused_target->y == 27) {  // target is NULL_COORD -> there is no possible target
-        *focused_target = random_shot(board_size);
-        return *focused_target;     // return -> no calculations (random)
-    }
 
-    _COORD calculation = *focused_target;  // there is set target
-    // firing in straight line e.g. XX~~ -> XXX~
-    if (*player_active->last_shot == HIT) { // tries straight line only if last strike was hit!
-        if (focused_target->x != (board_size - 1) && player_opponent->player_board[focused_target->x + 1][focused_target->y] == HIT) {
-            if (line_fire_right(player_opponent, board_size, &calculation)) return calculation; // right
-        }
-        if (focused_target->x != 0 && player_opponent->player_board[focused_target->x - 1][focused_target->y] == HIT) {
-            if (line_fire_left(player_opponent, board_size, &calculation)) return calculation;  // left
-        }
-        if (focused_target->y != 0 && player_opponent->player_board[focused_target->x][focused_target->y - 1] == HIT) {
-            if (line_fire_up(player_opponent, board_size, &calculation)) return calculation;    // up
+void* slab_alloc(SLAB* pool) {
+    /* Takes free object of pool (content is undefined). Returns NULL if there is no memory */
+
+    if (!pool->free_list) {
+        if (pool->slab_count == pool->slab_capacity) {
+            int capacity = pool->slab_capacity ? 2 * pool->slab_capacity : 16;
+            unsigned char** slabs = (unsigned char**) realloc(pool->slabs, sizeof(unsigned char*) * capacity);
+            if (!slabs) return NULL;
+            pool->slabs = slabs;
+            pool->slab_capacity = capacity;
         }
-        if (focused_target->y != (board_size - 1) && player_opponent->player_board[focused_target->x][focused_target->y + 1] == HIT) {
-            if (line_fire_down(player_opponent, board_size, &calculation)) return calculation;  // down
+        unsigned char* slab = (unsigned char*) malloc(pool->object_size * SLAB_OBJECTS);
+        if (!slab) return NULL;
+        pool->slabs[pool->slab_count++] = slab;
+        for (int i = SLAB_OBJECTS - 1; i >= 0; --i) {    // first object of slab is taken first
+            void* object = slab + i * pool->object_size;
+            *(void**) object = pool->free_list;
+            pool->free_list = object;
         }
     }
+    void* object = pool->free_list;
+    pool->free_list = *(void**) object;
+    pool->live++;
+    return object;
+}
 
-    // cannot find straight line -> firing around target
-    if (calculation_check(player_opponent, board_size, (short)(calculation.x + 1), (short)calculation.y) == VALID_MISS) {
-        calculation.x++;    // fire right
-        return calculation;
-    }
-    else if (calculation_check(player_opponent, board_size, (short)(calculation.x - 1), (short)calculation.y) == VALID_MISS) {
-        calculation.x--;    // fire left
-        return calculation;
+
+void slab_release(SLAB* pool, void* object) {
+    /* Gives object back to its pool */
+
+    *(void**) object = pool->free_list;
+    pool->free_list = object;
+    pool->live--;
+}
+
+
+void slab_free(SLAB* pool) {
+    /* Frees pool with all its objects */
+
+    for (int i = 0; i < pool->slab_count; ++i) free(pool->slabs[i]);
+    free(pool->slabs);
+    free(pool);
+}
+
+
+void run_hosted(unsigned long games, unsigned int board_size, int ai_level, int threads, int concurrent, uint64_t seed, const FLEET* fleet, SIM_STATS *stats) {
+    /* Same as run_interleaved, but concurrent games are kept only as compact sessions from slab pool - each thread
+    has one working game, restores session to it, steps it SCHEDULER_SLICE times and compacts it back. This is how
+    a server keeps many sessions which mostly wait. Game n is played with stream n of seed, so results are the
+    same as of run_tournament */
+
+    if (concurrent < 1) concurrent = 1;
+    if ((unsigned long)concurrent > games) concurrent = games ? games : 1;
+    if (threads > concurrent) threads = concurrent;
+
+    size_t size = compact_size(board_size, fleet->count);
+    SLAB* pool = slab_create(size);
+    HOSTED run = {0, games, board_size, ai_level, seed, fleet, NULL, concurrent, threads};
+    atomic_init(&run.next, concurrent);
+    run.sessions = (COMPACT**) malloc(sizeof(COMPACT*) * concurrent);
+    HOST_THREAD* workers = (HOST_THREAD*) ALIGNED_ALLOC(sizeof(HOST_THREAD) * threads);
+
+    double start = wall_time();
+    GAME* game = game_create(fleet);
+    for (int i = 0; i < concurrent; ++i) {
+        run.sessions[i] = (COMPACT*) slab_alloc(pool);
+        hosted_start(&run, game, i);
+        game_compact(game, run.sessions[i]);
     }
-    else if (calculation_check(player_opponent, board_size, (short)calculation.x, (short)(calculation.y - 1)) == VALID_MISS) {
-        calculation.y--;    // fire up
-        return calculation;
+    game_free(game);
+    printf("sessions:        %d x %zu bytes\n", concurrent, size);
+
+    for (int i = 0; i < threads; ++i) {
+        memset(&workers[i].stats, 0, sizeof(SIM_STATS));
+        workers[i].run = &run;
+        workers[i].id = i;
     }
-    else if (calculation_check(player_opponent, board_size, (short)calculation.x, (short)(calculation.y + 1)) == VALID_MISS) {
-        calculation.y++;    // fire down
-        return calculation;
+#ifdef HAS_THREADS
+    thrd_t thread[MAX_THREADS];
+    for (int i = 1; i < threads; ++i) thrd_create(&thread[i], hosted_worker, &workers[i]);
+    hosted_worker(&workers[0]);     // main thread works too
+    for (int i = 1; i < threads; ++i) thrd_join(thread[i], NULL);
+#else
+    for (int i = 0; i < threads; ++i) hosted_worker(&workers[i]);
+#endif
+
+    memset(stats, 0, sizeof(SIM_STATS));
+    for (int i = 0; i < threads; ++i) {     // merging results
+        stats->games += workers[i].stats.games;
+        stats->total_shots += workers[i].stats.total_shots;
+        for (int j = 0; j <= MAX_SHOTS; ++j) stats->histogram[j] += workers[i].stats.histogram[j];
     }
-    else return random_shot(board_size);
+    for (int i = 0; i < concurrent; ++i) slab_release(pool, run.sessions[i]);
+    stats->seconds = wall_time() - start;
+    stats->seed = seed;
+    stats->fleet = *fleet;
+    slab_free(pool);
+    free(run.sessions);
+    ALIGNED_FREE(workers);
 }
 
 
-int line_fire_right(PLAYER* player_opponent, unsigned int board_size, _COORD* calculation) {
-    /* Follows path of successful hits in given direction and if possible edits coordinates to shoot at */
+void hosted_start(HOSTED* run, GAME* game, unsigned long index) {
+    /* Starts game with given index of hosted simulation (computer vs computer) */
 
-    int flag = VALID_HIT;
-    _COORD new_calculation = *calculation;
-    new_calculation.x++;
-    while (1) {
-        new_calculation.x++;    // looks one tile right while following HIT tiles
-        flag = calculation_check(player_opponent, board_size, (short)new_calculation.x, (short)new_calculation.y);
-        if (flag == VALID_MISS) {   // can shoot at following tile
-            *calculation = new_calculation;
-            return 1;
+    game_start(game, run->board_size, run->seed, index);
+    game_set_ai(game, 0, run->ai_level);
+    game_set_ai(game, 1, run->ai_level);
+}
+
+
+int hosted_worker(void* arg) {
+    /* Body of one thread of hosted simulation. Steps own sessions in turns until all of them are finished and
+    no game is left to start. Finished game is counted and its session gets the next game */
+
+    HOST_THREAD* worker = (HOST_THREAD*) arg;
+    HOSTED* run = worker->run;
+    GAME* game = game_create(run->fleet);
+    if (simulation_archive) game_set_archive(game, simulation_archive);
+    int active = (run->concurrent - worker->id + run->threads - 1) / run->threads;
+
+    while (active) {
+        for (int i = worker->id; i < run->concurrent; i += run->threads) {
+            COMPACT* session = run->sessions[i];
+            if (session->phase == PHASE_FINISHED) continue;
+            game_restore(game, session);
+            for (int step = 0; step < SCHEDULER_SLICE && game_step(game); ++step);
+            if (game_phase(game) == PHASE_FINISHED) {
+                unsigned int shots = (game->shot_count + !game->winner) / 2;     // player 0 fires first
+                worker->stats.games++;
+                worker->stats.total_shots += shots;
+                worker->stats.histogram[shots < MAX_SHOTS ? shots : MAX_SHOTS]++;
+                unsigned long next = atomic_fetch_add(&run->next, 1);
+                if (next < run->games) hosted_start(run, game, next);
+                else active--;
+            }
+            game_compact(game, session);
         }
-        if (flag == INVALID) return 0;  // cannot strike at given direction
     }
+    game_free(game);
+    return 0;
 }
 
 
-int line_fire_left(PLAYER* player_opponent, unsigned int board_size, _COORD* calculation) {
-    /* Follows path of successful hits in given direction and if possible edits coordinates to shoot at */
+///////////////////////////////////////////////////
+///////////////////// BENCHMARK /////////////////
+///////////////////////////////////////////////////
 
-    int flag = VALID_HIT;
-    _COORD new_calculation = *calculation;
-    new_calculation.x--;    // looks one tile left while following HIT tiles
-    while (1) {
-        new_calculation.x--;
-        flag = calculation_check(player_opponent, board_size, (short)new_calculation.x, (short)new_calculation.y);
-        if (flag == VALID_MISS) {   // can shoot at following tile
-            *calculation = new_calculation;
-            return 1;
+
+static const BENCH_CASE BENCH_CASES[] = {
+    {"initialize", bench_initialize, AI_HUNT_TARGET, 0},
+    {"reset_session", bench_reset_session, AI_HUNT_TARGET, 0},
+    {"place_ship", bench_place_ship, AI_HUNT_TARGET, 0},
+    {"place_fleet", bench_place_fleet, AI_HUNT_TARGET, 0},
+    {"fire", bench_fire, AI_HUNT_TARGET, 0},
+    {"victory_check", bench_victory_check, AI_HUNT_TARGET, 1},
+    {"calculate_shot_hunt", bench_calculate_shot, AI_HUNT_TARGET, 1},
+    {"calculate_shot_probability", bench_calculate_shot, AI_PROBABILITY, 1},
+    {"print_both", bench_print_both, AI_HUNT_TARGET, 1},
+    {"game_hunt", bench_game, AI_HUNT_TARGET, 0},
+    {"game_probability", bench_game, AI_PROBABILITY, 0},
+};
+
+
+void run_benchmarks(unsigned int min_size, unsigned int max_size, uint64_t seed) {
+    /* Measures every benchmark case on every board size from min_size to max_size in one thread and prints
+    results as JSON - ns/op for each case and also games/s for whole games. Output of two runs (e.g. before
+    and after a change) can be compared by a script. The same seed prepares the same states */
+
+    BENCH* bench = (BENCH*) calloc(1, sizeof(BENCH));
+    bench->game = game_create(&CLASSIC_FLEET);
+    bench->session = &bench->game->session;
+    bench->ai = bench->game->ai;
+    bench->seed = seed;
+    int cases = sizeof(BENCH_CASES) / sizeof(BENCH_CASES[0]);
+    int first = 1;
+
+    printf("{\n  \"seed\": %llu,\n  \"bench_time\": %.3f,\n  \"results\": [", (unsigned long long)seed, BENCH_TIME);
+    for (unsigned int size = min_size; size <= max_size; ++size) {
+        bench->board_size = size;
+        for (int i = 0; i < cases; ++i) {
+            double ns = measure_case(bench, &BENCH_CASES[i]);
+            printf("%s\n    {\"size\": %u, \"name\": \"%s\", \"ns_per_op\": %.1f", first ? "" : ",", size, BENCH_CASES[i].name, ns);
+            if (BENCH_CASES[i].op == bench_game) printf(", \"games_per_s\": %.0f", 1e9 / ns);
+            printf("}");
+            fflush(stdout);     // long run shows progress
+            first = 0;
         }
-        if (flag == INVALID) return 0;  // cannot strike at given direction
     }
+    printf("\n  ]\n}\n");
+
+    free(bench->frame.data);
+    game_free(bench->game);
+    free(bench);
 }
 
 
-int line_fire_up(PLAYER* player_opponent, unsigned int board_size, _COORD* calculation) {
-    /* Follows path of successful hits in given direction and if possible edits coordinates to shoot at */
+double measure_case(BENCH* bench, const BENCH_CASE* bench_case) {
+    /* Prepares state for the case and repeats its operation in doubling batches until
+    one batch takes at least BENCH_TIME. Returns nanoseconds per operation of that batch */
 
-    int flag = VALID_HIT;
-    _COORD new_calculation = *calculation;
-    new_calculation.y--;    // looks one tile up while following HIT tiles
-    while (1) {
-        new_calculation.y--;
-        flag = calculation_check(player_opponent, board_size, (short)new_calculation.x, (short)new_calculation.y);
-        if (flag == VALID_MISS) {   // can shoot at following tile
-            *calculation = new_calculation;
-            return 1;
-        }
-        if (flag == INVALID) return 0;  // cannot strike at given direction
+    prepare_benchmark(bench, bench_case);
+    unsigned long done = 0;
+
+    for (unsigned long batch = 1; ; batch *= 2) {
+        double start = wall_time();
+        for (unsigned long i = 0; i < batch; ++i) bench_case->op(bench, done + i);
+        double seconds = wall_time() - start;
+        done += batch;
+        if (seconds >= BENCH_TIME) return seconds * 1e9 / batch;
     }
 }
 
 
-int line_fire_down(PLAYER* player_opponent, unsigned int board_size, _COORD* calculation) {
-    /* Follows path of successful hits in given direction and if possible edits coordinates to shoot at */
+void prepare_benchmark(BENCH* bench, const BENCH_CASE* bench_case) {
+    /* Resets session and both AIs, places both fleets and generates random ship positions
+    and order of tiles. For midgame cases both computers fire until half of the board
+    is shot (or game ends). Opponent's state is saved for fire benchmark */
 
-    int flag = VALID_HIT;
-    _COORD new_calculation = *calculation;
-    new_calculation.y++;    // looks one tile down while following HIT tiles
-    while (1) {
-        new_calculation.y++;
-        flag = calculation_check(player_opponent, board_size, (short)new_calculation.x, (short)new_calculation.y);
-        if (flag == VALID_MISS) {   // can shoot at following tile
-            *calculation = new_calculation;
-            return 1;
-        }
-        if (flag == INVALID) return 0;  // cannot strike at given direction
+    SESSION* session = bench->session;
+    unsigned int board_size = bench->board_size;
+    int tiles = board_size * board_size;
+
+    bench->ai_level = bench_case->ai_level;
+    seed_random(&bench->rng, bench->seed, board_size);
+    game_start(bench->game, board_size, bench->seed, board_size);
+    for (int i = 0; i < 2; ++i) {
+        game_set_ai(bench->game, i, bench_case->ai_level);
+        game_place_random(bench->game, i);
+    }
+    game_begin(bench->game);
+    for (int i = 0; i < 2; ++i) seed_random(&bench->ai[i].rng, bench->seed, i);
+
+    for (int i = 0; i < BENCH_SHIPS; ++i) {
+        bench->ships[i].orientation = random_below(&bench->rng, 2);
+        bench->ships[i].size = 2 + random_below(&bench->rng, MAX_SHIP - 1);
+        bench->ships[i].x = random_below(&bench->rng, board_size);
+        bench->ships[i].y = random_below(&bench->rng, board_size);
+    }
+    for (int i = 0; i < tiles; ++i) bench->order[i] = i;
+    for (int i = tiles - 1; i > 0; --i) {   // Fisher-Yates shuffle
+        int j = random_below(&bench->rng, i + 1);
+        unsigned short tile = bench->order[i];
+        bench->order[i] = bench->order[j];
+        bench->order[j] = tile;
+    }
+
+    for (int i = 0; bench_case->midgame && i < tiles / 4; ++i) {
+        if (computer_shot(bench->game)) break;
+        if (computer_shot(bench->game)) break;
+    }
+    bench->saved_board = session->boards[1];
+    bench->saved_player = session->players[1];
+}
+
+
+void bench_initialize(BENCH* bench, unsigned long i) {
+    /* Clears one board */
+
+    (void)i;    // every call does the same work
+    initialize(&bench->session->boards[0]);
+    bench->sink += bench->session->boards[0].ships[0];
+}
+
+
+void bench_reset_session(BENCH* bench, unsigned long i) {
+    /* Clears both boards and both fleets (replaces freeing and allocating of boards) */
+
+    (void)i;    // every call does the same work
+    reset_session(bench->session);
+    bench->sink += bench->session->players[0].ships_afloat;
+}
+
+
+void bench_place_ship(BENCH* bench, unsigned long i) {
+    /* Tries to place ship at random position to board with fleet. Placed ship is removed again,
+    so board stays the same - both fitting and not fitting positions are measured */
+
+    unsigned int board_size = bench->board_size;
+    BOARD* board = &bench->session->boards[0];
+    SHIP ship = bench->ships[i % BENCH_SHIPS];
+
+    if (place_ship(board, board_size, ship)) return;
+    int step = ship.orientation == HORIZONTAL ? 1 : board_size;
+    for (int j = 0; j < ship.size; ++j) bit_clear(board->ships, tile_index(ship.x, ship.y, board_size) + j*step);
+    bench->sink++;
+}
+
+
+void bench_place_fleet(BENCH* bench, unsigned long i) {
+    /* Places whole computer's fleet */
+
+    (void)i;    // every call does the same work
+    placement_of_ships_computer(&bench->session->players[0], &bench->session->rng, bench->board_size);
+    bench->sink += bench->session->players[0].ships[0].origin;
+}
+
+
+void bench_fire(BENCH* bench, unsigned long i) {
+    /* Fires at tiles of opponent's board in random order. When every tile was
+    shot, opponent is restored (once per board_size^2 shots) */
+
+    unsigned int board_size = bench->board_size;
+    SESSION* session = bench->session;
+    int tile = i % (board_size * board_size);
+
+    if (tile == 0) {
+        session->boards[1] = bench->saved_board;
+        session->players[1] = bench->saved_player;
     }
+    SHOT shot = fire(&session->players[1], tile_coord(bench->order[tile], board_size), board_size);
+    bench->sink += shot.flag;
+}
+
+
+void bench_victory_check(BENCH* bench, unsigned long i) {
+    /* Checks fleet in the middle of game */
+
+    (void)i;    // every call does the same work
+    bench->sink += victory_check(&bench->session->players[1]);
+}
+
+
+void bench_calculate_shot(BENCH* bench, unsigned long i) {
+    /* Chooses next shot in the middle of game (state does not change, so the same position is measured) */
+
+    (void)i;    // every call does the same work
+    SESSION* session = bench->session;
+    _COORD aim = calculate_shot(&session->players[1], bench->board_size, &bench->ai[0]);
+    bench->sink += aim.x + aim.y;
+}
+
+
+void bench_print_both(BENCH* bench, unsigned long i) {
+    /* Composes whole game screen in the middle of game. Frame is emptied instead of printed */
+
+    (void)i;    // every call does the same work
+    SESSION* session = bench->session;
+    bench->frame.length = 0;
+    bench->frame.color = NULL;
+    print_both(&bench->frame, &session->players[0], &session->players[1], bench->board_size);
+    bench->sink += bench->frame.length;
+}
+
+
+void bench_game(BENCH* bench, unsigned long i) {
+    /* Plays whole computer vs computer game, game i with stream i of the seed */
+
+    game_start(bench->game, bench->board_size, bench->seed, i);
+    bench->sink += simulate_game(bench->game, bench->ai_level);
+}
+
+
+///////////////////////////////////////////////////
+///////////////////// SELF TEST ///////////////////
+///////////////////////////////////////////////////
+
+
+int run_selftest() {
+    /* Runs quick deterministic checks of generator streams, record format, analysis of damaged records,
+    compact sessions and bot protocol. Prints every failed check and a summary. Returns exit code of program */
+
+    int checks = 0, failed = 0;
+    selftest_random(&checks, &failed);
+    selftest_records(&checks, &failed);
+    selftest_compact(&checks, &failed);
+    selftest_bot(&checks, &failed);
+    printf("selftest: %d checks, %d failed\n", checks, failed);
+    return failed ? 1 : 0;
+}
+
+
+void selftest_check(int* checks, int* failed, int ok, const char* what) {
+    /* Counts one check and prints it if it failed */
+
+    (*checks)++;
+    if (ok) return;
+    (*failed)++;
+    printf("FAILED: %s\n", what);
 }
 
 
-int calculation_check(PLAYER* player_opponent, unsigned int board_size, short x, short y) {
-    /* Checks calculated coordinates and returns, whether tile is UNKNOWN, HIT or cannot shoot there */
+void selftest_random(int* checks, int* failed) {
+    /* The same stream of a seed repeats exactly, other stream or seed differs, random_below stays in bound */
+
+    RNG a, b, c, d;
+    seed_random(&a, 42, 7);
+    seed_random(&b, 42, 7);
+    seed_random(&c, 42, 8);
+    seed_random(&d, 43, 7);
+    int same = 1, other_stream = 0, other_seed = 0;
+    for (int i = 0; i < 1000; ++i) {
+        uint64_t value = next_random(&a);
+        same &= value == next_random(&b);
+        other_stream += value != next_random(&c);
+        other_seed += value != next_random(&d);
+    }
+    selftest_check(checks, failed, same, "same seed and stream repeat the numbers");
+    selftest_check(checks, failed, other_stream > 990, "other stream gives other numbers");
+    selftest_check(checks, failed, other_seed > 990, "other seed gives other numbers");
+
+    int in_bound = 1;
+    for (uint32_t bound = 1; bound < 2000; ++bound) in_bound &= random_below(&a, bound) < bound;
+    selftest_check(checks, failed, in_bound, "random_below stays below bound");
+}
+
 
-    if (x < 0 || x >= board_size) return INVALID;
-    if (y < 0 || y >= board_size) return INVALID;
-    if (player_opponent->player_board[x][y] == HIT) return VALID_HIT;
-    if (player_opponent->player_board[x][y] == DEFAULT) return VALID_MISS;  // UNKNOWN for PC
-    if (player_opponent->player_board[x][y] == PLACED_SHIP) return VALID_MISS;  // UNKNOWN for PC
+int selftest_play(GAME* game, unsigned int board_size, uint64_t stream) {
+    /* Plays computer vs computer game of selftest (probability AI against hunt/target AI). Returns winner */
 
-    return INVALID;     // SUNK or MISS options
+    game_start(game, board_size, 2024, stream);
+    game_set_ai(game, 0, AI_PROBABILITY);
+    game_set_ai(game, 1, AI_HUNT_TARGET);
+    while (game_step(game));
+    return game_winner(game);
 }
 
 
-_COORD find_last_hit(PLAYER* player_opponent, unsigned int board_size) {
-    /* Goes through opponent's board and returns coordinates of first HIT tile.
-    If no HIT was found, returns NULL_COORD {27, 27} */
+void selftest_records(int* checks, int* failed) {
+    /* Games are recorded to temporary file and read back - each record has to match the game played again with
+    its seed and stream. Then analysis has to count a good record and skip damaged ones without counting them */
+
+    FILE* file = tmpfile();
+    if (!file) {
+        selftest_check(checks, failed, 0, "temporary file for records");
+        return;
+    }
+    ARCHIVE archive;
+    archive.file = file;
+#ifdef HAS_THREADS
+    mtx_init(&archive.lock, mtx_plain);
+#endif
+    fwrite(ARCHIVE_MAGIC, 1, sizeof(ARCHIVE_MAGIC), file);
+    GAME* game = game_create(&CLASSIC_FLEET);
+    game_set_archive(game, &archive);
+    for (int i = 0; i < 20; ++i) selftest_play(game, i < 10 ? 10 : 20, i);     // one and two bytes per shot
+    game_set_archive(game, NULL);   // writes what is buffered
+
+    RECORDS records = {NULL, 0, 0};
+    long size = ftell(file);
+    records.data = (unsigned char*) malloc(size);
+    rewind(file);
+    records.size = fread(records.data, 1, size, file);
+    fclose(file);
+#ifdef HAS_THREADS
+    mtx_destroy(&archive.lock);
+#endif
 
-    _COORD result = NULL_COORD;
-    for (int i = 0; i < board_size; ++i) {
-        for (int j = 0; j < board_size; ++j) {
-            if (player_opponent->player_board[j][i] == HIT) {   // finds hit in board
-                result.x = j;
-                result.y = i;
-                return result;
+    RECORD record;
+    size_t offset = 0, first = 0;
+    int count = 0, match = 1;
+    while ((offset = records_next(&records, offset, &record))) {
+        if (!count) first = offset;
+        selftest_play(game, count < 10 ? 10 : 20, count);
+        match &= record.seed == 2024 && record.stream == (uint64_t)count && record.board_size == game->board_size;
+        match &= record.winner == game->winner && (int)record.shot_count == game->shot_count;
+        match &= record.ai_level[0] == AI_PROBABILITY && record.ai_level[1] == AI_HUNT_TARGET;
+        for (unsigned int i = 0; match && i < record.shot_count; ++i) match &= record_shot(&record, i) == game->shots[i];
+        for (int player = 0; match && player < 2; ++player) {
+            for (int id = 0; id < (int)record.fleet_count; ++id) {
+                FLEET_SHIP* ship = &game->session.players[player].ships[id];
+                SHIP read = record_ship(&record, player, id);
+                match &= tile_index(read.x, read.y, game->board_size) == (int)ship->origin;
+                match &= read.orientation == ship->orientation && read.size == ship->size;
             }
         }
+        count++;
     }
-    return result;  // no hit was found - returns NULL_COORD {27, 27}
+    selftest_check(checks, failed, count == 20, "all recorded games are read back");
+    selftest_check(checks, failed, match, "records match replayed games");
+    game_free(game);
+
+    // analysis of first record (10x10) - good one is counted, damaged ones change nothing
+    size_t start = sizeof(ARCHIVE_MAGIC);
+    size_t length = first - start;
+    records_next(&records, 0, &record);
+    ANALYSIS* analysis = (ANALYSIS*) calloc(1, sizeof(ANALYSIS));
+    ANALYSIS* before = (ANALYSIS*) malloc(sizeof(ANALYSIS));
+    selftest_check(checks, failed, !analyze_record(analysis, &record) && analysis->boards[10].games == 1, "good record is analyzed");
+
+    memcpy(before, analysis, sizeof(ANALYSIS));
+    unsigned char* damaged = records.data + start + RECORD_HEADER;  // first ship of player 0
+    damaged[0] |= HORIZONTAL << 7;
+    put_bytes(damaged + 1, 13 * 10, 2);    // row 13 of 10x10 board
+    records_next(&records, 0, &record);
+    selftest_check(checks, failed, analyze_record(analysis, &record) && !memcmp(before, analysis, sizeof(ANALYSIS)), "ship off the board is skipped");
+    put_bytes(damaged + 1, 0xFFFF, 2);
+    records_next(&records, 0, &record);
+    selftest_check(checks, failed, analyze_record(analysis, &record) && !memcmp(before, analysis, sizeof(ANALYSIS)), "origin off the board is skipped");
+
+    put_bytes(damaged + 1, 0, 2);
+    damaged[0] = CLASS_COUNT;
+    records_next(&records, 0, &record);
+    selftest_check(checks, failed, analyze_record(analysis, &record) && !memcmp(before, analysis, sizeof(ANALYSIS)), "unknown class of ship is skipped");
+
+    damaged[0] = 0;
+    records.data[start + length - 1] = 100;     // last shot of 10x10 game
+    records_next(&records, 0, &record);
+    selftest_check(checks, failed, analyze_record(analysis, &record) && !memcmp(before, analysis, sizeof(ANALYSIS)), "shot off the board is skipped");
+
+    free(before);
+    free(analysis);
+    free(records.data);
 }
 
 
-_COORD random_shot(unsigned int board_size) {
-    /* Generates coordinates of random tile on enemy board */
+void selftest_compact(int* checks, int* failed) {
+    /* Game compacted and restored to other game (through a copy of compact state) every few moves has to end
+    exactly as the same game played without it. So does game compacted while only computer's fleet is placed.
+    Compact state with unknown class of ship is refused */
+
+    GAME* game = game_create(&CLASSIC_FLEET);
+    GAME* other = game_create(&CLASSIC_FLEET);
+    GAME* reference = game_create(&CLASSIC_FLEET);
+    size_t size = compact_size(10, CLASSIC_FLEET.count);
+    COMPACT* compact = (COMPACT*) malloc(size);
+    COMPACT* copy = (COMPACT*) malloc(size);
+    int same = 1;
+
+    for (int stream = 0; stream < 20; ++stream) {
+        selftest_play(reference, 10, stream);
+        game_start(game, 10, 2024, stream);
+        game_set_ai(game, 0, AI_PROBABILITY);
+        game_set_ai(game, 1, AI_HUNT_TARGET);
+        for (int moves = 0; game_step(game); ++moves) {
+            if (moves % 3) continue;
+            game_compact(game, compact);
+            memcpy(copy, compact, size);
+            same &= !game_restore(other, copy);
+            GAME* swap = game;
+            game = other;
+            other = swap;
+        }
+        same &= game->shot_count == reference->shot_count && game->winner == reference->winner;
+        same &= !memcmp(game->shots, reference->shots, sizeof(game->shots[0]) * game->shot_count);
+    }
+    selftest_check(checks, failed, same, "restored compact sessions play on exactly");
+
+    // human (player 0) still places while computer's fleet is ready - then both games go on the same way
+    same = 1;
+    for (int stream = 0; stream < 5; ++stream) {
+        game_start(game, 10, 2024, stream);
+        game_set_ai(game, 1, AI_HUNT_TARGET);
+        game_place_random(game, 1);
+        game_compact(game, compact);
+        same &= !game_restore(other, compact) && !other->placed[0] && other->placed[1];
+        for (int id = 0; id < CLASSIC_FLEET.count; ++id) {
+            FLEET_SHIP* ship = &game->session.players[1].ships[id];
+            FLEET_SHIP* restored = &other->session.players[1].ships[id];
+            same &= ship->origin == restored->origin && ship->orientation == restored->orientation;
+        }
+        GAME* both[2] = {game, other};
+        for (int i = 0; i < 2; ++i) {
+            game_set_ai(both[i], 0, AI_PROBABILITY);
+            game_place_random(both[i], 0);
+            game_begin(both[i]);
+            while (game_step(both[i]));
+        }
+        same &= game->shot_count == other->shot_count && game->winner == other->winner;
+        same &= !memcmp(game->shots, other->shots, sizeof(game->shots[0]) * game->shot_count);
+    }
+    selftest_check(checks, failed, same, "compact session restores fleet placed before its opponent's");
+
+    game_compact(reference, compact);
+    compact->data[0] = CLASS_COUNT;
+    selftest_check(checks, failed, game_restore(other, compact), "compact session with unknown class is refused");
 
-    _COORD result;
-    result.x = rand()%board_size;
-    result.y = rand()%board_size;    // generates random ship position
+    free(compact);
+    free(copy);
+    game_free(game);
+    game_free(other);
+    game_free(reference);
+}
+
+
+void selftest_bot(int* checks, int* failed) {
+    /* Bot protocol is run on commands from temporary file and its answers are compared. Needs POSIX descriptors
+    (bot reads stdin without stdio) - skipped elsewhere */
+
+#if defined(__unix__) || defined(__APPLE__)
+    char first[64] = "", answers[4096] = "";
+    if (selftest_bot_run("new 1 10\nshoot 1\n", first, sizeof(first))) {
+        selftest_check(checks, failed, 0, "temporary files for bot");
+        return;
+    }
+    char shot[16] = "", wrong[16] = "A1";
+    selftest_check(checks, failed, sscanf(first, "shot 1 %15s", shot) == 1, "bot answers shot");
+    if (!strcmp(shot, "A1")) strcpy(wrong, "B2");
+
+    char* commands = (char*) malloc(BOT_BUFFER + 256);
+    int length = sprintf(commands, "new 1 10\nplace 1\nshoot 1\nresult 1 %s miss\nresult 1 %s miss\nshoot 1\n", wrong, shot);
+    memset(commands + length, 'x', BOT_BUFFER + 16);    // longer than buffer
+    sprintf(commands + length + BOT_BUFFER + 16, " tail\nping ok\nnew 1 3\nbogus\nshoot 1x\nquit\n");
+    selftest_bot_run(commands, answers, sizeof(answers));
+    free(commands);
+
+    char expected[256];
+    sprintf(expected, "shot 1 %s\nerror 1 result of tile which was not shot\nshot 1 ", shot);
+    char* after = strstr(answers, expected);
+    selftest_check(checks, failed, !strncmp(answers, "place 1 ", 8), "bot places fleet");
+    selftest_check(checks, failed, after != NULL, "bot rejects result of tile it did not shoot");
+    selftest_check(checks, failed, after && strncmp(after + strlen(expected), shot, strlen(shot)), "bot takes result of its shot");
+    selftest_check(checks, failed, strstr(answers, "error - line longer than") != NULL, "bot drops overlong line");
+    selftest_check(checks, failed, !strstr(answers, "tail") && strstr(answers, "\npong ok\n") != NULL, "bot goes on after overlong line");
+    selftest_check(checks, failed, strstr(answers, "error 1 size must be") != NULL, "bot refuses too small board");
+    selftest_check(checks, failed, strstr(answers, "error - unknown command 'bogus'") != NULL, "bot refuses unknown command");
+    selftest_check(checks, failed, strstr(answers, "error - id must be") != NULL, "bot answers invalid id with '-'");
+#else
+    (void)checks;
+    (void)failed;
+#endif
+}
+
+
+#if defined(__unix__) || defined(__APPLE__)
+int selftest_bot_run(const char* commands, char* answers, size_t size) {
+    /* Runs bot_mode with commands as its stdin and reads its stdout (up to size - 1 bytes) to answers. Both go
+    through temporary files. Returns 1 if they cannot be created */
+
+    FILE* input = tmpfile();
+    FILE* output = tmpfile();
+    int ok = input && output;
+    if (ok) ok = fputs(commands, input) >= 0 && fflush(input) == 0;
+
+    if (ok) {
+        rewind(input);
+        fflush(stdout);
+        int saved_in = dup(STDIN_FILENO), saved_out = dup(STDOUT_FILENO);
+        dup2(fileno(input), STDIN_FILENO);
+        dup2(fileno(output), STDOUT_FILENO);
+        bot_mode(AI_HUNT_TARGET, 7, 1);
+        fflush(stdout);
+        dup2(saved_in, STDIN_FILENO);
+        dup2(saved_out, STDOUT_FILENO);
+        close(saved_in);
+        close(saved_out);
+
+        rewind(output);
+        answers[fread(answers, 1, size - 1, output)] = '\0';
+    }
+    if (input) fclose(input);
+    if (output) fclose(output);
+    return !ok;
+}
+#endif
+
+
+///////////////////////////////////////////////////
+/////////////////// INSTRUMENTATION ///////////////
+///////////////////////////////////////////////////
+
+#ifdef INSTRUMENT
+
+
+void instrument_start() {
+    /* Counters are printed to stderr when program ends, on Ctrl+C and on SIGUSR1 (program continues) */
+
+    atexit(instrument_dump);
+    signal(SIGINT, instrument_signal);
+#ifdef SIGUSR1
+    signal(SIGUSR1, instrument_signal);
+#endif
+}
+
+
+void instrument_signal(int signal_number) {
+    /* Prints counters. Ctrl+C then ends program as usual. Printing from signal handler is not safe
+    in general, but instrumented build is meant only for debugging */
+
+    instrument_dump();
+    if (signal_number == SIGINT) {
+        signal(SIGINT, SIG_DFL);
+        raise(SIGINT);
+    }
+    else signal(signal_number, instrument_signal);  // some systems reset handler after every signal
+}
+
+
+void instrument_record(_Atomic unsigned long histogram[], double seconds) {
+    /* Adds duration to histogram with buckets of doubling size (in microseconds) */
+
+    unsigned long long microseconds = seconds * 1e6;
+    int bucket = 0;
+    while (microseconds && bucket < LATENCY_BUCKETS - 1) {
+        microseconds >>= 1;
+        bucket++;
+    }
+    atomic_fetch_add_explicit(&histogram[bucket], 1, memory_order_relaxed);
+}
+
+
+void instrument_dump() {
+    /* Prints all counters and non-empty rows of histograms */
+
+    fprintf(stderr, "\n--- instrumentation ---\n");
+    fprintf(stderr, "invalid player shots:   %lu\n", atomic_load(&instrument.invalid_player));
+    fprintf(stderr, "invalid computer shots: %lu\n", atomic_load(&instrument.invalid_computer));
+    fprintf(stderr, "place_ship rejections:  %lu\n", atomic_load(&instrument.place_rejects));
+    fprintf(stderr, "placement misses:       %lu\n", atomic_load(&instrument.placement_misses));
+    fprintf(stderr, "placement scans:        %lu\n", atomic_load(&instrument.placement_scans));
+    fprintf(stderr, "fleet restarts:         %lu\n", atomic_load(&instrument.fleet_restarts));
+    fprintf(stderr, "random shots:           %lu\n", atomic_load(&instrument.random_shots));
+    fprintf(stderr, "parity fallbacks:       %lu\n", atomic_load(&instrument.parity_fallbacks));
+    fprintf(stderr, "candidate refills:      %lu\n", atomic_load(&instrument.candidate_refills));
+    fprintf(stderr, "monte carlo samples:    %lu\n", atomic_load(&instrument.mc_samples));
+    fprintf(stderr, "monte carlo rejects:    %lu\n", atomic_load(&instrument.mc_rejects));
+    fprintf(stderr, "monte carlo fallbacks:  %lu\n", atomic_load(&instrument.mc_fallbacks));
+    fprintf(stderr, "monte carlo misses:     %lu\n", atomic_load(&instrument.mc_sample_misses));
+    fprintf(stderr, "monte carlo scans:      %lu\n", atomic_load(&instrument.mc_sample_scans));
+    fprintf(stderr, "speculated moves:       %lu\n", atomic_load(&instrument.speculated_moves));
+    print_histogram("computer turn", instrument.computer_turns);
+    print_histogram("player turn", instrument.player_turns);
+    print_histogram("render", instrument.renders);
+}
+
+
+void print_histogram(const char* name, _Atomic unsigned long histogram[]) {
+    /* Prints one histogram - each row is upper limit of bucket and number of durations in it */
+
+    fprintf(stderr, "%s latency (< us: count):\n", name);
+    for (int i = 0; i < LATENCY_BUCKETS; ++i) {
+        unsigned long count = atomic_load(&histogram[i]);
+        if (count) fprintf(stderr, "%12llu: %lu\n", 1ULL << i, count);
+    }
+}
+
+
+#endif
+
+
+///////////////////////////////////////////////////
+////////////////////// RANDOM /////////////////////
+///////////////////////////////////////////////////
 
-    if (result.x%2 == result.y%2) return random_shot(board_size);   // if both coordinates are same parity -> restart
-    else return result;
+
+void seed_random(RNG* rng, uint64_t seed, uint64_t stream) {
+    /* Fills state of generator from seed and number of stream (e.g. index of game). Each word
+    is scrambled by splitmix64, so close seeds or streams give unrelated sequences */
+
+    uint64_t x = seed ^ stream * 0xD1B54A32D192ED03ULL;     // odd multiplier spreads stream over all bits
+    for (int i = 0; i < 4; ++i) {
+        uint64_t z = (x += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        rng->s[i] = z ^ (z >> 31);
+    }
+    if (!(rng->s[0] | rng->s[1] | rng->s[2] | rng->s[3])) rng->s[0] = 1;    // state must not be zero
+}
+
+
+uint64_t next_random(RNG* rng) {
+    /* Returns next 64 random bits of given generator (xoshiro256**) - replaces rand() */
+
+    uint64_t* s = rng->s;
+    uint64_t result = rotate_left(s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotate_left(s[3], 45);
+    return result;
+}
+
+
+uint32_t random_below(RNG* rng, uint32_t bound) {
+    /* Returns random number from 0 to bound - 1, each with the same chance (unlike next_random() % bound).
+    Upper 32 bits are multiplied by bound, the few products which would make lower numbers more likely
+    are thrown away (Lemire's method) - division is needed only rarely */
+
+    uint64_t product = (next_random(rng) >> 32) * bound;
+    if ((uint32_t)product < bound) {
+        uint32_t threshold = -bound % bound;    // 2^32 mod bound
+        while ((uint32_t)product < threshold) product = (next_random(rng) >> 32) * bound;
+    }
+    return product >> 32;
 }
 
+
+static inline uint64_t rotate_left(uint64_t word, int bits) {
+    return (word << bits) | (word >> (64 - bits));
+}